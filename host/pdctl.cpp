@@ -0,0 +1,378 @@
+// Host client for the dispenser's binary protocol over USB serial: reads state,
+// counters and EEPROM, triggers calibration and dispensing, streams telemetry.
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame.h"
+#include "proto.h"
+
+namespace {
+
+struct Frame {
+    uint8_t kind = 0;
+    uint8_t seq = 0;
+    uint8_t cmd = 0;
+    uint8_t status = 0;
+    std::vector<uint8_t> payload;
+};
+
+uint16_t get_u16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+uint32_t get_u32(const uint8_t *p) { return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16); }
+
+uint64_t mono_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+class Client {
+public:
+    ~Client() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    bool open_port(const char *path) {
+        fd_ = open(path, O_RDWR | O_NOCTTY);
+        if (fd_ < 0) {
+            std::fprintf(stderr, "(ERROR) open %s: %s\n", path, std::strerror(errno));
+            return false;
+        }
+        termios tio;
+        if (tcgetattr(fd_, &tio) != 0) {
+            std::fprintf(stderr, "(ERROR) %s is not a serial port\n", path);
+            return false;
+        }
+        cfmakeraw(&tio);
+        cfsetspeed(&tio, B115200); // ignored by USB CDC, needed for a UART bridge
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd_, TCSANOW, &tio);
+        tcflush(fd_, TCIFLUSH);
+        return true;
+    }
+
+    // Send a request and wait for the response with the same seq and cmd
+    bool request(uint8_t cmd, const std::vector<uint8_t> &arg, Frame &resp, int timeout_ms = 2000) {
+        uint8_t seq = ++seq_;
+        std::vector<uint8_t> raw = { PROTO_KIND_REQUEST, seq, cmd, PROTO_OK };
+        raw.insert(raw.end(), arg.begin(), arg.end());
+        uint16_t crc = frame_crc16(raw.data(), raw.size());
+        raw.push_back((uint8_t)crc);
+        raw.push_back((uint8_t)(crc >> 8));
+
+        std::vector<uint8_t> wire(raw.size() + raw.size() / 254 + 3);
+        wire[0] = 0;
+        size_t n = cobs_encode(raw.data(), raw.size(), wire.data() + 1);
+        wire[n + 1] = 0;
+        if (!write_all(wire.data(), n + 2)) return false;
+
+        uint64_t deadline = mono_ms() + (uint64_t)timeout_ms;
+        while (read_frame(resp, deadline)) {
+            if (resp.kind == PROTO_KIND_RESPONSE && resp.seq == seq && resp.cmd == cmd) return true;
+        }
+        std::fprintf(stderr, "(ERROR) no response to command 0x%02x\n", cmd);
+        return false;
+    }
+
+    // Next valid frame before the deadline; text and damaged frames are skipped
+    bool read_frame(Frame &out, uint64_t deadline) {
+        while (true) {
+            size_t end;
+            while (find_delimiter(end)) {
+                std::vector<uint8_t> chunk(rx_.begin(), rx_.begin() + (long)end);
+                rx_.erase(rx_.begin(), rx_.begin() + (long)end + 1);
+                if (decode(chunk, out)) return true;
+            }
+
+            uint64_t now = mono_ms();
+            if (now >= deadline) return false;
+            pollfd pfd = { fd_, POLLIN, 0 };
+            if (poll(&pfd, 1, (int)(deadline - now)) <= 0) continue;
+            uint8_t buf[512];
+            ssize_t got = read(fd_, buf, sizeof(buf));
+            if (got < 0 && errno != EAGAIN && errno != EINTR) return false;
+            if (got > 0) rx_.insert(rx_.end(), buf, buf + got);
+        }
+    }
+
+private:
+    bool find_delimiter(size_t &end) const {
+        for (size_t i = 0; i < rx_.size(); ++i) {
+            if (rx_[i] == 0) {
+                end = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool decode(const std::vector<uint8_t> &chunk, Frame &out) {
+        if (chunk.empty() || chunk.size() > PROTO_MAX_FRAME + PROTO_MAX_FRAME / 254 + 1) return false;
+        uint8_t raw[PROTO_MAX_FRAME];
+        size_t len = cobs_decode(chunk.data(), chunk.size(), raw);
+        if (len < PROTO_HEADER_SIZE + 2) return false;
+        len -= 2;
+        if (get_u16(raw + len) != frame_crc16(raw, len)) return false;
+
+        out.kind = raw[0];
+        out.seq = raw[1];
+        out.cmd = raw[2];
+        out.status = raw[3];
+        out.payload.assign(raw + PROTO_HEADER_SIZE, raw + len);
+        return true;
+    }
+
+    bool write_all(const uint8_t *p, size_t len) {
+        while (len > 0) {
+            ssize_t n = write(fd_, p, len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::fprintf(stderr, "(ERROR) write: %s\n", std::strerror(errno));
+                return false;
+            }
+            p += n;
+            len -= (size_t)n;
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+    uint8_t seq_ = 0;
+    std::vector<uint8_t> rx_;
+};
+
+const char *status_name(uint8_t status) {
+    switch (status) {
+        case PROTO_OK:        return "ok";
+        case PROTO_ERR_CMD:   return "unknown command";
+        case PROTO_ERR_ARG:   return "bad argument";
+        case PROTO_ERR_STATE: return "not allowed in this state";
+        case PROTO_ERR_IO:    return "EEPROM error";
+        case PROTO_ERR_BUSY:  return "busy (calibrating or dispensing), retry later";
+        default:              return "unknown status";
+    }
+}
+
+const char *sys_name(uint8_t sys) {
+    switch (sys) {
+        case SYS_BOOT:            return "boot";
+        case SYS_WAIT_CAL_BUTTON: return "wait-cal";
+        case SYS_CALIBRATING:     return "calibrating";
+        case SYS_READY_TO_START:  return "ready";
+        case SYS_DISPENSING:      return "dispensing";
+        case SYS_EMPTY:           return "empty";
+        default:                  return "?";
+    }
+}
+
+// Numeric argument in [min, max]; out-of-range values are an error, never truncated
+bool parse_arg(const char *s, unsigned long min, unsigned long max, const char *what, unsigned long &out) {
+    char *end;
+    errno = 0;
+    out = std::strtoul(s, &end, 0);
+    if (errno || end == s || *end || *s == '-' || out < min || out > max) {
+        std::fprintf(stderr, "(ERROR) %s must be %lu-%lu, got '%s'\n", what, min, max, s);
+        return false;
+    }
+    return true;
+}
+
+bool check(const Frame &resp) {
+    if (resp.status == PROTO_OK) return true;
+    std::fprintf(stderr, "(ERROR) device: %s\n", status_name(resp.status));
+    return false;
+}
+
+void print_snapshot(const std::vector<uint8_t> &p) {
+    if (p.size() < PROTO_SNAPSHOT_HEADER) return;
+    uint8_t wheels = p[5];
+    std::printf("uptime %.1f s  state %s  wheels %u\n", get_u32(&p[0]) / 1000.0, sys_name(p[4]), wheels);
+    for (uint8_t w = 0; w < wheels; ++w) {
+        size_t at = PROTO_SNAPSHOT_HEADER + (size_t)w * PROTO_SNAPSHOT_WHEEL;
+        if (at + PROTO_SNAPSHOT_WHEEL > p.size()) break;
+        const uint8_t *s = &p[at];
+        std::printf("  wheel %u: slot %u  done %u  remaining %u  %s%s  boots %u  dispensed %u  missed %u\n",
+                    w, s[0], s[1], s[2], (s[3] & 0x1) ? "calibrated" : "uncalibrated",
+                    (s[3] & 0x2) ? " mid-turn" : "", get_u32(s + 4), get_u32(s + 8), get_u32(s + 12));
+    }
+}
+
+// The record layout is the same on the RP2040 and common hosts (little-endian, natural alignment)
+void print_state(const std::vector<uint8_t> &p) {
+    if (p.size() != sizeof(nv_state_t)) {
+        std::fprintf(stderr, "(ERROR) state is %zu bytes, expected %zu\n", p.size(), sizeof(nv_state_t));
+        return;
+    }
+    nv_state_t st;
+    std::memcpy(&st, p.data(), sizeof(st));
+    std::printf("magic 0x%08x  version %u\n", st.magic, st.version);
+    std::printf("slot %u  dispenses_done %u  pills_remaining %u\n", st.current_slot, st.dispenses_done, st.pills_remaining);
+    std::printf("calibrated %d  motor_in_progress %d  joined_network %d\n",
+                st.calibrated, st.motor_in_progress, st.joined_network);
+    std::printf("boots %u  dispensed %u  missed %u  last_event_ms %u\n",
+                st.boots_count, st.pills_dispensed_count, st.pills_missed_count, st.last_event_ms);
+    std::printf("steps_per_rev wave %u  full %u  half %u  steps_per_slot %u\n",
+                st.steps_per_rev[0], st.steps_per_rev[1], st.steps_per_rev[2], st.steps_per_slot);
+    std::printf("dose intervals (min):");
+    for (uint16_t m : st.dose_interval_min) std::printf(" %u", m);
+    std::printf("  skip mask 0x%02x\n", st.dose_skip_mask);
+}
+
+void usage(const char *argv0) {
+    std::fprintf(stderr,
+                 "usage: %s PORT COMMAND\n"
+                 "  ping\n"
+                 "  state [WHEEL]               persisted record of a wheel\n"
+                 "  counters                    uptime, system state and per-wheel counters\n"
+                 "  eeprom ADDR LEN [FILE]      bulk EEPROM read, hex dump or raw to FILE\n"
+                 "  schedule [DOSE MINUTES [SKIP]]  show, or set dose DOSE (1-7) to MINUTES\n"
+                 "                              after the previous one (0 = default, max 65535)\n"
+                 "  calibrate | start | dispense\n"
+                 "  telemetry PERIOD_MS [COUNT] stream snapshots (COUNT 0 = until killed)\n",
+                 argv0);
+}
+
+int run(Client &c, int argc, char **argv) {
+    std::string cmd = argv[2];
+    Frame r;
+
+    if (cmd == "ping") {
+        uint64_t t = mono_ms();
+        if (!c.request(PROTO_CMD_PING, { 'p', 'd' }, r) || !check(r)) return 1;
+        std::printf("pong in %llu ms\n", (unsigned long long)(mono_ms() - t));
+        return 0;
+    }
+
+    if (cmd == "state") {
+        unsigned long wheel = 0;
+        if (argc > 3 && !parse_arg(argv[3], 0, 255, "wheel", wheel)) return 1;
+        if (!c.request(PROTO_CMD_GET_STATE, { (uint8_t)wheel }, r) || !check(r)) return 1;
+        print_state(r.payload);
+        return 0;
+    }
+
+    if (cmd == "counters") {
+        if (!c.request(PROTO_CMD_GET_COUNTERS, {}, r) || !check(r)) return 1;
+        print_snapshot(r.payload);
+        return 0;
+    }
+
+    if (cmd == "eeprom" && argc > 4) {
+        unsigned long addr, len;
+        if (!parse_arg(argv[3], 0, 0xFFFF, "address", addr) || !parse_arg(argv[4], 1, 0x10000, "length", len)) return 1;
+        if (addr + len > 0x10000) {
+            std::fprintf(stderr, "(ERROR) range past the 16-bit address space\n");
+            return 1;
+        }
+        std::vector<uint8_t> data;
+        while (data.size() < len) {
+            uint16_t at = (uint16_t)(addr + data.size());
+            uint8_t n = (uint8_t)std::min<size_t>(len - data.size(), PROTO_MAX_PAYLOAD);
+            if (!c.request(PROTO_CMD_READ_EEPROM, { (uint8_t)at, (uint8_t)(at >> 8), n }, r) || !check(r)) return 1;
+            data.insert(data.end(), r.payload.begin(), r.payload.end());
+        }
+
+        if (argc > 5) {
+            FILE *f = std::fopen(argv[5], "wb");
+            if (!f || std::fwrite(data.data(), 1, data.size(), f) != data.size()) {
+                std::fprintf(stderr, "(ERROR) write %s failed\n", argv[5]);
+                if (f) std::fclose(f);
+                return 1;
+            }
+            std::fclose(f);
+            std::printf("%zu bytes written to %s\n", data.size(), argv[5]);
+            return 0;
+        }
+        for (size_t i = 0; i < data.size(); i += 16) {
+            std::printf("%04lx ", addr + i);
+            for (size_t j = i; j < i + 16 && j < data.size(); ++j) std::printf(" %02x", data[j]);
+            std::printf("\n");
+        }
+        return 0;
+    }
+
+    if (cmd == "schedule") {
+        if (argc > 4) {
+            unsigned long dose, minutes, skip = 0;
+            if (!parse_arg(argv[3], 1, DISPENSE_SLOTS, "dose", dose) ||
+                !parse_arg(argv[4], 0, 0xFFFF, "interval (minutes)", minutes) ||
+                (argc > 5 && !parse_arg(argv[5], 0, 1, "skip", skip))) {
+                return 1;
+            }
+            std::vector<uint8_t> arg = { (uint8_t)(dose - 1), (uint8_t)minutes, (uint8_t)(minutes >> 8), (uint8_t)skip };
+            if (!c.request(PROTO_CMD_SET_SCHEDULE, arg, r) || !check(r)) return 1;
+        }
+        if (!c.request(PROTO_CMD_GET_SCHEDULE, {}, r) || !check(r)) return 1;
+        if (r.payload.size() != 2 * DISPENSE_SLOTS + 1) return 1;
+        uint8_t mask = r.payload[2 * DISPENSE_SLOTS];
+        for (int d = 0; d < DISPENSE_SLOTS; ++d) {
+            uint16_t m = get_u16(&r.payload[2 * d]);
+            std::string interval = "default interval";
+            if (m) interval = std::to_string(m / 60) + " h " + std::to_string(m % 60) + " min";
+            std::printf("dose %d: %s%s\n", d + 1, interval.c_str(),
+                        (mask & (1u << d)) ? "  (skipped)" : "");
+        }
+        return 0;
+    }
+
+    if (cmd == "calibrate" || cmd == "start" || cmd == "dispense") {
+        uint8_t code = cmd == "calibrate" ? PROTO_CMD_CALIBRATE
+                     : cmd == "start"     ? PROTO_CMD_START
+                                          : PROTO_CMD_DISPENSE_NOW;
+        if (!c.request(code, {}, r) || !check(r)) return 1;
+        std::printf("%s accepted\n", cmd.c_str());
+        return 0;
+    }
+
+    if (cmd == "telemetry" && argc > 3) {
+        unsigned long period, count = 0;
+        if (!parse_arg(argv[3], 0, 0xFFFF, "period (ms)", period) ||
+            (argc > 4 && !parse_arg(argv[4], 0, ULONG_MAX, "count", count))) {
+            return 1;
+        }
+        if (!c.request(PROTO_CMD_TELEMETRY, { (uint8_t)period, (uint8_t)(period >> 8) }, r) || !check(r)) return 1;
+        if (period == 0) return 0;
+
+        // Telemetry continues through calibration and dispensing; allow for EEPROM writes
+        for (unsigned long seen = 0; count == 0 || seen < count;) {
+            if (!c.read_frame(r, mono_ms() + period + 2000)) {
+                std::fprintf(stderr, "(ERROR) telemetry stopped\n");
+                return 1;
+            }
+            if (r.kind != PROTO_KIND_TELEMETRY) continue;
+            print_snapshot(r.payload);
+            std::fflush(stdout);
+            ++seen;
+        }
+        c.request(PROTO_CMD_TELEMETRY, { 0, 0 }, r);
+        return 0;
+    }
+
+    usage(argv[0]);
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 2;
+    }
+    Client c;
+    if (!c.open_port(argv[1])) return 1;
+    return run(c, argc, argv);
+}
@@ -1,6 +1,12 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// Marks mutable firmware state. Empty on the Pico; the host fleet simulator
+// (sim/) defines it as _Thread_local to run one device per thread.
+#ifndef DEVICE_LOCAL
+#define DEVICE_LOCAL
+#endif
+
 // GPIO
 #define PIN_OPTO          28
 #define PIN_PIEZO         27
@@ -10,6 +16,13 @@
 #define PIN_STEPPER_IN3    6
 #define PIN_STEPPER_IN4   13
 
+// Dispensing wheels: one row/entry per wheel. For a second wheel add e.g.
+// { 10, 11, 12, 14 } to WHEEL_STEPPER_PINS and its opto/piezo pins below.
+#define WHEEL_COUNT         1
+#define WHEEL_STEPPER_PINS  { { PIN_STEPPER_IN1, PIN_STEPPER_IN2, PIN_STEPPER_IN3, PIN_STEPPER_IN4 } }
+#define WHEEL_OPTO_PINS     { PIN_OPTO }
+#define WHEEL_PIEZO_PINS    { PIN_PIEZO }
+
 #define PIN_LED1          20
 #define PIN_LED2          21
 #define PIN_LED3          22
@@ -29,6 +42,7 @@
 #define PIN_I2C_SCL       17
 #define I2C_BAUD          400000
 #define EEPROM_ADDR       0x50
+#define EEPROM_PAGE_SIZE  32         // 24C32: a write past a page end wraps to its start
 
 // Dispenser configuration
 #define TOTAL_COMPARTMENTS        8
@@ -38,6 +52,16 @@
 // Timing (testing mode)
 #define DISPENSE_INTERVAL_MS      5000  // 5s for testing, change to 30 seconds later
 #define STEPPER_STEP_DELAY_US     2000   // ~833 Hz
+#define BOOT_REPORT_TIMEOUT_MS    3000   // print boot timing even if no USB host shows up
+#define SCHEDULE_CHECKPOINT_MS    (10u * 60u * 1000u)  // dose wait saved this often (one EEPROM cell)
+
+// Stepper drive modes (see stepper_mode_t)
+#define STEPPER_SLOT_MODE         STEPPER_MODE_FULL  // routine slot moves: fastest reliable
+#define STEPPER_CAL_MODE          STEPPER_MODE_HALF  // calibration: finest resolution
+#define STEPPER_WAVE_DELAY_US     3000   // one coil, less torque: keep it slower
+#define STEPPER_FULL_DELAY_US     2800   // two coils: ~1.4x half-step speed, 1.4 ms per half-step for slow motors
+#define STEPPER_RAMP_START_US     4000   // first step delay of a move
+#define STEPPER_RAMP_STEPS        24     // steps to accelerate/decelerate over
 
 #define NOMINAL_FULL_REV_STEPS    4096
 #define NOMINAL_SLOT_STEPS        (NOMINAL_FULL_REV_STEPS / TOTAL_COMPARTMENTS)
@@ -62,7 +86,7 @@
 // EEPROM layout
 #define STATE_MAGIC       0xA1B2C3D4
 #define STATE_VERSION     1
-#define EEPROM_STATE_ADDR 0x0000     // start of EEPROM
+#define EEPROM_STATE_ADDR 0x0000     // start of EEPROM; wheel n at + n * EEPROM_STATE_SIZE
 #define EEPROM_STATE_SIZE 128        // enough for struct
 
 #endif
@@ -0,0 +1,22 @@
+#ifndef FRAME_H
+#define FRAME_H
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+uint16_t frame_crc16(const uint8_t *data, size_t len);
+
+// COBS: the encoded output has no 0x00 bytes, so 0x00 can delimit frames.
+// dst needs len + len / 254 + 1 bytes. decode returns 0 on malformed input.
+size_t cobs_encode(const uint8_t *src, size_t len, uint8_t *dst);
+size_t cobs_decode(const uint8_t *src, size_t len, uint8_t *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef PROTO_H
+#define PROTO_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "state.h"
+
+// Binary command/telemetry protocol on the stdio link.
+// Wire: 0x00, COBS(header | payload | crc16 LE), 0x00. Text printf output may sit
+// between frames; it fails the CRC and receivers drop it.
+// Header: kind, seq, cmd, status. Multi-byte payload fields are little-endian.
+
+#define PROTO_MAX_PAYLOAD   240
+#define PROTO_HEADER_SIZE   4
+#define PROTO_MAX_FRAME     (PROTO_HEADER_SIZE + PROTO_MAX_PAYLOAD + 2)
+
+typedef enum {
+    PROTO_KIND_REQUEST   = 0x01,
+    PROTO_KIND_RESPONSE  = 0x02,
+    PROTO_KIND_TELEMETRY = 0x03,
+} proto_kind_t;
+
+typedef enum {
+    PROTO_CMD_PING          = 0x01, // payload echoed back
+    PROTO_CMD_GET_STATE     = 0x02, // req: wheel u8; resp: raw nv_state_t
+    PROTO_CMD_GET_COUNTERS  = 0x03, // resp: snapshot (same as telemetry)
+    PROTO_CMD_READ_EEPROM   = 0x04, // req: addr u16, len u8; resp: bytes
+    PROTO_CMD_CALIBRATE     = 0x05, // same as the CAL button; only while waiting for it
+    PROTO_CMD_START         = 0x06, // same as the START button; only when ready to start
+    PROTO_CMD_DISPENSE_NOW  = 0x07, // make the pending dose due immediately; only while dispensing
+    PROTO_CMD_TELEMETRY     = 0x08, // req: period_ms u16 (0 = off)
+    PROTO_CMD_GET_SCHEDULE  = 0x09, // resp: interval_min u16 per dose, skip mask u8
+    PROTO_CMD_SET_SCHEDULE  = 0x0A, // req: dose u8, interval_min u16 (0 = default), skip u8
+} proto_cmd_t;
+
+typedef enum {
+    PROTO_OK          = 0x00,
+    PROTO_ERR_CMD     = 0x01, // unknown command
+    PROTO_ERR_ARG     = 0x02, // bad length or range
+    PROTO_ERR_STATE   = 0x03, // not possible in the current system state
+    PROTO_ERR_IO      = 0x04, // EEPROM access failed
+    PROTO_ERR_BUSY    = 0x05, // calibration or a dose in progress; retry later
+} proto_status_t;
+
+// Snapshot payload: uptime_ms u32, system state u8, wheel count u8, then per wheel:
+// current_slot u8, dispenses_done u8, pills_remaining u8, flags u8
+// (bit0 calibrated, bit1 motor_in_progress), boots u32, dispensed u32, missed u32
+#define PROTO_SNAPSHOT_HEADER 6
+#define PROTO_SNAPSHOT_WHEEL  16
+
+// Actions the state machine has to carry out for a request
+typedef enum {
+    PROTO_ACTION_NONE = 0,
+    PROTO_ACTION_CALIBRATE,
+    PROTO_ACTION_START,
+    PROTO_ACTION_DISPENSE_NOW,
+} proto_action_t;
+
+// Drain received bytes, answer complete requests and send due telemetry.
+// Never blocks.
+proto_action_t proto_poll(system_state_t sys);
+
+// The same from inside blocking work (stepper waits, calibration steps, the piezo
+// window, the error blink), reporting the state of the last proto_poll. Reads and telemetry keep
+// working; action commands get PROTO_ERR_BUSY. The link is only silent during boot
+// and single EEPROM write cycles (5 ms each).
+void proto_service(void);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+#include <stdbool.h>
+#include <stdint.h>
+
+// Dose schedule. Dose i is due interval(i) after dose i-1 (or after start for dose 0).
+// Intervals and skips live in wheel 0's nv_state_t so they survive power loss.
+// Only intervals are supported: the Pico has no battery-backed clock and nothing on
+// the device knows the time of day, so absolute dose times would be lost on every
+// power cut until a host set the clock again.
+void schedule_init(void);
+// Begin a new cycle: dose 0 is due one interval from now
+void schedule_start(void);
+// Continue a cycle after a reboot, crediting the wait saved before power was lost.
+// Time spent without power is not known and not credited.
+void schedule_resume(void);
+
+// Setters persist the change; 0 minutes selects DISPENSE_INTERVAL_MS
+void schedule_set_interval_min(uint8_t dose, uint16_t minutes);
+uint32_t schedule_interval_ms(uint8_t dose);
+// A skipped dose still advances the wheel past its compartment, which the operator
+// leaves empty; it counts as done but neither as dispensed nor as missed.
+void schedule_set_skip(uint8_t dose, bool skip);
+bool schedule_is_skipped(uint8_t dose);
+
+// Arm the hardware alarm for a dose, relative to the previous dose's due time
+void schedule_arm(uint8_t dose);
+bool schedule_dose_due(void);
+// Make the armed dose due now; later doses keep their original times
+void schedule_fire_now(void);
+
+// Sleep the core until the dose alarm or any other interrupt (e.g. a button) fires,
+// then persist the wait if a checkpoint has passed
+void schedule_sleep(void);
+
+#endif
@@ -7,11 +7,11 @@
 // Initialize sensors
 void sensors_init(void);
 
-// Opto sensor check
-bool opto_is_opening_at_sensor(void);
+// Opto sensor check, per wheel
+bool opto_is_opening_at_sensor(uint8_t wheel);
 
-// Piezo interrupt helpers
-bool piezo_was_triggered(void);
-void piezo_reset_flag(void);
+// Piezo interrupt helpers, per wheel
+bool piezo_was_triggered(uint8_t wheel);
+void piezo_reset_flag(uint8_t wheel);
 
 #endif
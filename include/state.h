@@ -2,6 +2,8 @@
 #define STATE_H
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "config.h"
 
 typedef enum {
     SYS_BOOT = 0,
@@ -34,16 +36,33 @@ typedef struct {
     // Timestamps just in case we use it
     uint32_t last_event_ms;
 
+    // Calibrated steps per revolution, indexed by stepper_mode_t (0 = not calibrated)
+    uint16_t steps_per_rev[3];
+
+    // Dose schedule: per-dose interval in minutes, up to ~45 days (0 = DISPENSE_INTERVAL_MS),
+    // skip bit per dose
+    uint16_t dose_interval_min[7];
+    uint8_t dose_skip_mask;
+    // Wait toward dose dose_wait_dose, in SCHEDULE_CHECKPOINT_MS steps, so a reboot resumes it
+    uint8_t dose_wait_dose;
+    uint16_t dose_wait_checkpoints;
+
     // Reserved for future
-    uint8_t reserved[32];
+    uint8_t reserved[8];
     uint16_t steps_per_slot; // dynamically calibrated
 
 } nv_state_t;
 
-extern nv_state_t g_state;
+// One persisted record per dispensing wheel
+extern DEVICE_LOCAL nv_state_t g_states[WHEEL_COUNT];
+
+void state_init_defaults(uint8_t wheel);
+bool state_load(uint8_t wheel);
+void state_save(uint8_t wheel);
+void state_save_range(uint8_t wheel, size_t offset, size_t len);
 
-void state_init_defaults(void);
-void state_load(void);
-void state_save(void);
+// Persist a single field of a wheel's record, e.g. STATE_SAVE_FIELD(0, boots_count)
+#define STATE_SAVE_FIELD(wheel, field) \
+    state_save_range((wheel), offsetof(nv_state_t, field), sizeof(((nv_state_t *)0)->field))
 
 #endif
@@ -2,24 +2,61 @@
 #define STEPPER_H
 #include <stdbool.h>
 #include <stdint.h>
+#include "state.h"
 
-void stepper_init(void);
-void stepper_mark_motion_begin(void);
-void stepper_mark_motion_end(void);
+// Drive modes. Positions are tracked in half-steps regardless of mode.
+typedef enum {
+    STEPPER_MODE_WAVE = 0,  // one coil at a time: lowest current
+    STEPPER_MODE_FULL,      // two coils at a time: most torque at speed
+    STEPPER_MODE_HALF,      // alternating one/two coils: finest resolution
+    STEPPER_MODE_COUNT
+} stepper_mode_t;
 
-void stepper_step_sequence_once(void);
-void stepper_steps(uint32_t steps);
+// One dispensing wheel: its motor, opto sensor and persisted state
+typedef struct {
+    uint8_t wheel;             // index into g_states and the WHEEL_* pin tables
+    uint8_t pins[4];
+    nv_state_t *state;
 
-void stepper_advance_one_slot(void);
-void stepper_full_turn_nominal(void);
+    stepper_mode_t mode;
+    uint8_t seq_phase;         // last energised phase
+    int32_t position_half;     // half-steps travelled from the calibration slot
+    uint8_t current_slot;
+
+    // Alarm-driven move in progress
+    volatile bool busy;
+    uint32_t move_steps;
+    uint32_t move_done;
+} stepper_t;
+
+void stepper_init(stepper_t *m, uint8_t wheel);
+void stepper_mark_motion_begin(stepper_t *m);
+void stepper_mark_motion_end(stepper_t *m);
+
+// Drive mode
+void stepper_set_mode(stepper_t *m, stepper_mode_t mode);
+stepper_mode_t stepper_get_mode(const stepper_t *m);
+
+void stepper_step_sequence_once(stepper_t *m);
+void stepper_steps(stepper_t *m, uint32_t steps);
+
+// Non-blocking moves, stepped from a hardware alarm so several wheels run at once
+void stepper_steps_async(stepper_t *m, uint32_t steps);
+bool stepper_busy(const stepper_t *m);
+void stepper_wait(stepper_t *m);
+
+void stepper_advance_one_slot(stepper_t *m);
+void stepper_advance_one_slot_async(stepper_t *m);
+void stepper_full_turn_nominal(stepper_t *m);
 
 // Calibration
-uint32_t stepper_calibrate_revolution(void);
-bool calibrate_two_revolutions(uint32_t *rev1_steps, uint32_t *rev2_steps);
+uint32_t stepper_calibrate_revolution(stepper_t *m);
+bool calibrate_two_revolutions(stepper_t *m, uint32_t *rev1_steps, uint32_t *rev2_steps);
+void stepper_store_calibration(stepper_t *m, uint32_t rev_steps);
 
 // Slot utilities
-void slot_set(uint8_t slot_index);
-void slot_advance(void);
-uint8_t slot_get(void);
+void slot_set(stepper_t *m, uint8_t slot_index);
+void slot_advance(stepper_t *m);
+uint8_t slot_get(const stepper_t *m);
 
 #endif
@@ -0,0 +1,333 @@
+// Fleet simulator: runs the dispenser firmware as many independent devices,
+// spread over all cores, and aggregates dispensing, calibration, power-cut
+// recovery and EEPROM wear statistics.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sim_device.h"
+#include "state.h"
+
+namespace {
+
+// Each worker owns a deque: it pops from the back, idle workers steal from the front
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned workers) {
+        for (unsigned i = 0; i < workers; ++i) queues_.push_back(std::make_unique<Queue>());
+    }
+
+    void run(size_t tasks, const std::function<void(size_t task, unsigned worker)> &fn) {
+        for (size_t t = 0; t < tasks; ++t) queues_[t % queues_.size()]->items.push_back(t);
+
+        std::vector<std::thread> threads;
+        for (unsigned w = 0; w < queues_.size(); ++w) {
+            threads.emplace_back([this, w, &fn] {
+                size_t task;
+                while (pop_local(w, task) || steal(w, task)) fn(task, w);
+            });
+        }
+        for (auto &t : threads) t.join();
+    }
+
+    uint64_t steals() const { return steals_.load(); }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> items;
+    };
+
+    bool pop_local(unsigned w, size_t &task) {
+        Queue &q = *queues_[w];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.items.empty()) return false;
+        task = q.items.back();
+        q.items.pop_back();
+        return true;
+    }
+
+    // Tasks never spawn tasks, so finding every queue empty means the run is done
+    bool steal(unsigned w, size_t &task) {
+        for (size_t i = 1; i < queues_.size(); ++i) {
+            Queue &q = *queues_[(w + i) % queues_.size()];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.items.empty()) continue;
+            task = q.items.front();
+            q.items.pop_front();
+            steals_++;
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::atomic<uint64_t> steals_{0};
+};
+
+struct Options {
+    uint32_t devices = 64;
+    double days = 90;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t seed = 1;
+    double interval_h = 8;
+    double cut_mean_h = 72;
+    long trace = -1;
+};
+
+struct FleetStats {
+    uint64_t devices = 0;
+    uint64_t boots = 0, power_cuts = 0, cuts_during_write = 0;
+    uint64_t recover_clean = 0, recover_mid_turn = 0, recover_defaults = 0, recover_torn_valid = 0;
+    uint64_t cycles = 0, loaded = 0, dropped = 0, detected = 0, slipped = 0;
+    uint64_t calibrations = 0, calibration_us_total = 0, calibration_us_max = 0;
+    uint64_t fw_dispensed = 0, fw_missed = 0;
+    uint64_t eeprom_writes = 0;
+    std::vector<uint64_t> cell_total = std::vector<uint64_t>(SIM_EEPROM_SIZE);
+    std::vector<uint32_t> cell_max = std::vector<uint32_t>(SIM_EEPROM_SIZE);
+    std::vector<int64_t> latencies;
+
+    void add(const sim_stats_t &s, std::vector<int64_t> &lat) {
+        devices++;
+        boots += s.boots;
+        power_cuts += s.power_cuts;
+        cuts_during_write += s.cuts_during_write;
+        recover_clean += s.recover_clean;
+        recover_mid_turn += s.recover_mid_turn;
+        recover_defaults += s.recover_defaults;
+        recover_torn_valid += s.recover_torn_valid;
+        cycles += s.cycles_started;
+        loaded += s.pills_loaded;
+        dropped += s.pills_dropped;
+        detected += s.pills_detected;
+        slipped += s.steps_slipped;
+        calibrations += s.calibrations;
+        calibration_us_total += s.calibration_us_total;
+        calibration_us_max = std::max(calibration_us_max, s.calibration_us_max);
+        fw_dispensed += s.fw_dispensed;
+        fw_missed += s.fw_missed;
+        eeprom_writes += s.eeprom_writes;
+        for (size_t i = 0; i < SIM_EEPROM_SIZE; ++i) {
+            cell_total[i] += s.cell_writes[i];
+            cell_max[i] = std::max(cell_max[i], s.cell_writes[i]);
+        }
+        latencies.insert(latencies.end(), lat.begin(), lat.end());
+    }
+
+    void merge(const FleetStats &o) {
+        devices += o.devices;
+        boots += o.boots;
+        power_cuts += o.power_cuts;
+        cuts_during_write += o.cuts_during_write;
+        recover_clean += o.recover_clean;
+        recover_mid_turn += o.recover_mid_turn;
+        recover_defaults += o.recover_defaults;
+        recover_torn_valid += o.recover_torn_valid;
+        cycles += o.cycles;
+        loaded += o.loaded;
+        dropped += o.dropped;
+        detected += o.detected;
+        slipped += o.slipped;
+        calibrations += o.calibrations;
+        calibration_us_total += o.calibration_us_total;
+        calibration_us_max = std::max(calibration_us_max, o.calibration_us_max);
+        fw_dispensed += o.fw_dispensed;
+        fw_missed += o.fw_missed;
+        eeprom_writes += o.eeprom_writes;
+        for (size_t i = 0; i < SIM_EEPROM_SIZE; ++i) {
+            cell_total[i] += o.cell_total[i];
+            cell_max[i] = std::max(cell_max[i], o.cell_max[i]);
+        }
+        latencies.insert(latencies.end(), o.latencies.begin(), o.latencies.end());
+    }
+};
+
+struct Field {
+    const char *name;
+    size_t offset;
+    size_t size;
+};
+
+#define NV_FIELD(f) { #f, offsetof(nv_state_t, f), sizeof(((nv_state_t *)0)->f) }
+const Field nv_fields[] = {
+    NV_FIELD(magic), NV_FIELD(version), NV_FIELD(current_slot), NV_FIELD(dispenses_done),
+    NV_FIELD(pills_remaining), NV_FIELD(joined_network), NV_FIELD(motor_in_progress),
+    NV_FIELD(calibrated), NV_FIELD(boots_count), NV_FIELD(pills_dispensed_count),
+    NV_FIELD(pills_missed_count), NV_FIELD(last_event_ms), NV_FIELD(steps_per_rev),
+    NV_FIELD(dose_interval_min), NV_FIELD(dose_skip_mask), NV_FIELD(dose_wait_dose),
+    NV_FIELD(dose_wait_checkpoints), NV_FIELD(reserved),
+    NV_FIELD(steps_per_slot),
+};
+#undef NV_FIELD
+
+std::string cell_name(size_t addr) {
+    size_t wheel = (addr - EEPROM_STATE_ADDR) / EEPROM_STATE_SIZE;
+    size_t off = (addr - EEPROM_STATE_ADDR) % EEPROM_STATE_SIZE;
+    if (wheel >= WHEEL_COUNT) return "-";
+    std::string prefix = "wheel " + std::to_string(wheel) + " ";
+    for (const Field &f : nv_fields) {
+        if (off >= f.offset && off < f.offset + f.size) return prefix + f.name;
+    }
+    return prefix + (off < sizeof(nv_state_t) ? "(struct padding)" : "(record padding)");
+}
+
+void simulate_device(uint32_t id, const Options &opt, const sim_params_t &params, FleetStats &out) {
+    auto dev = std::make_unique<sim_device_t>();
+    std::vector<int64_t> latencies;
+    sim_device_init(dev.get(), id, opt.seed, &params);
+    dev->latency_sink = &latencies;
+    dev->trace = opt.trace == (long)id;
+
+    for (;;) {
+        // A fresh thread per power-on gives the firmware freshly initialised DEVICE_LOCAL state
+        sim_exit_t why = SIM_EXIT_HORIZON;
+        std::thread boot([&] { why = sim_device_boot(dev.get()); });
+        boot.join();
+        if (why == SIM_EXIT_HORIZON) break;
+        sim_device_power_off(dev.get());
+    }
+    sim_device_finish(dev.get());
+    out.add(dev->stats, latencies);
+}
+
+double percentile_s(std::vector<int64_t> &v, double p) {
+    if (v.empty()) return 0;
+    size_t i = std::min(v.size() - 1, (size_t)(p * (double)(v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + (long)i, v.end());
+    return (double)v[i] / 1e6;
+}
+
+double pct(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+void report(FleetStats &s, const Options &opt, double wall_s, uint64_t steals) {
+    double device_days = (double)s.devices * opt.days;
+
+    printf("Fleet: %llu devices x %.0f days, %u workers, seed %llu\n",
+           (unsigned long long)s.devices, opt.days, opt.threads, (unsigned long long)opt.seed);
+    printf("  wall %.2f s, %.0f device-days/s, %llu tasks stolen\n\n",
+           wall_s, wall_s > 0 ? device_days / wall_s : 0.0, (unsigned long long)steals);
+
+    printf("Dispensing\n");
+    printf("  cycles started        %llu\n", (unsigned long long)s.cycles);
+    printf("  pills loaded          %llu\n", (unsigned long long)s.loaded);
+    printf("  pills dropped         %llu (%.2f%% of loaded)\n", (unsigned long long)s.dropped, pct(s.dropped, s.loaded));
+    printf("  piezo triggered       %llu (%.2f%% of dropped)\n", (unsigned long long)s.detected, pct(s.detected, s.dropped));
+    printf("  firmware dispensed    %llu\n", (unsigned long long)s.fw_dispensed);
+    printf("  firmware missed       %llu (miss rate %.2f%%)\n", (unsigned long long)s.fw_missed,
+           pct(s.fw_missed, s.fw_dispensed + s.fw_missed));
+    printf("  steps slipped         %llu\n", (unsigned long long)s.slipped);
+    printf("  dose latency (s)      p50 %.1f  p90 %.1f  p99 %.1f  max %.1f  (n=%zu)\n\n",
+           percentile_s(s.latencies, 0.50), percentile_s(s.latencies, 0.90),
+           percentile_s(s.latencies, 0.99), percentile_s(s.latencies, 1.0), s.latencies.size());
+
+    printf("Calibration\n");
+    printf("  runs                  %llu\n", (unsigned long long)s.calibrations);
+    printf("  time (s)              mean %.1f  max %.1f\n\n",
+           s.calibrations ? (double)s.calibration_us_total / (double)s.calibrations / 1e6 : 0.0,
+           (double)s.calibration_us_max / 1e6);
+
+    printf("Power cuts\n");
+    printf("  cuts                  %llu (%llu during an EEPROM write)\n",
+           (unsigned long long)s.power_cuts, (unsigned long long)s.cuts_during_write);
+    printf("  boots                 %llu\n", (unsigned long long)s.boots);
+    printf("  recovered records     clean %llu, mid-turn %llu, reset to defaults %llu\n",
+           (unsigned long long)s.recover_clean, (unsigned long long)s.recover_mid_turn,
+           (unsigned long long)s.recover_defaults);
+    printf("  torn but valid        %llu (no checksum catches these)\n\n", (unsigned long long)s.recover_torn_valid);
+
+    printf("EEPROM wear\n");
+    printf("  page writes           %.1f per device-day\n", device_days > 0 ? (double)s.eeprom_writes / device_days : 0.0);
+    std::vector<size_t> cells(SIM_EEPROM_SIZE);
+    for (size_t i = 0; i < cells.size(); ++i) cells[i] = i;
+    std::sort(cells.begin(), cells.end(), [&](size_t a, size_t b) { return s.cell_max[a] > s.cell_max[b]; });
+    printf("  hottest cells         addr   mean/dev    max/dev  years to 1M  field\n");
+    for (size_t i = 0; i < 8 && s.cell_max[cells[i]] > 0; ++i) {
+        size_t c = cells[i];
+        double per_day = (double)s.cell_max[c] / opt.days;
+        printf("                        0x%03zx %10.0f %10u %12.1f  %s\n", c,
+               (double)s.cell_total[c] / (double)s.devices, s.cell_max[c],
+               per_day > 0 ? 1e6 / per_day / 365.0 : 0.0, cell_name(c).c_str());
+    }
+}
+
+void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [--devices N] [--days D] [--threads T] [--seed S]\n"
+            "          [--interval-h H] [--cut-mean-h H] [--trace DEVICE]\n", argv0);
+}
+
+bool parse(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (i + 1 >= argc) return false;
+        const char *v = argv[++i];
+        if (a == "--devices") opt.devices = (uint32_t)strtoul(v, nullptr, 10);
+        else if (a == "--days") opt.days = strtod(v, nullptr);
+        else if (a == "--threads") opt.threads = std::max(1u, (unsigned)strtoul(v, nullptr, 10));
+        else if (a == "--seed") opt.seed = strtoull(v, nullptr, 10);
+        else if (a == "--interval-h") {
+            // Stored as whole minutes in a uint16 (1 min to ~45 days); reject rather than clamp
+            opt.interval_h = strtod(v, nullptr);
+            double minutes = std::round(opt.interval_h * 60.0);
+            if (minutes < 1 || minutes > 65535) {
+                fprintf(stderr, "--interval-h must be between 1/60 and %.1f hours\n", 65535 / 60.0);
+                return false;
+            }
+        }
+        else if (a == "--cut-mean-h") opt.cut_mean_h = strtod(v, nullptr);
+        else if (a == "--trace") opt.trace = strtol(v, nullptr, 10);
+        else return false;
+    }
+    return true;
+}
+
+} // namespace
+
+extern "C" void sim_record_latency(void *sink, int64_t latency_us) {
+    static_cast<std::vector<int64_t> *>(sink)->push_back(latency_us);
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse(argc, argv, opt)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    sim_params_t params{};
+    params.horizon_us = (uint64_t)(opt.days * 86400.0 * 1e6);
+    params.dose_interval_min = (uint16_t)std::lround(opt.interval_h * 60.0);
+    params.cut_mean_hours = opt.cut_mean_h;
+    params.downtime_mean_s = 120;
+    params.refill_mean_s = 20 * 60;
+    params.start_mean_s = 60;
+    params.piezo_detect_p = 0.98;
+    params.slip_p = 1e-6;
+    params.slip_fast_p = 0.2;
+
+    std::vector<FleetStats> per_worker(opt.threads);
+    WorkStealingPool pool(opt.threads);
+    auto t0 = std::chrono::steady_clock::now();
+    pool.run(opt.devices, [&](size_t task, unsigned worker) {
+        simulate_device((uint32_t)task, opt, params, per_worker[worker]);
+    });
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    FleetStats total;
+    for (const FleetStats &w : per_worker) total.merge(w);
+    report(total, opt, wall_s, pool.steals());
+    return 0;
+}
@@ -0,0 +1,572 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pico/stdlib.h"
+#include "pico/stdio_usb.h"
+#include "pico/multicore.h"
+#include "hardware/i2c.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/scb.h"
+#include "config.h"
+#include "state.h"
+#include "sim_device.h"
+
+#define SIM_POLL_US       5        // cost of one trip round a polling loop
+#define SIM_EEPROM_TWC_US 3500     // EEPROM write cycle, inside the firmware's 5 ms wait
+#define SIM_PRESS_US      300000   // how long the operator holds a button
+#define SIM_FALL_MIN_US   200000   // pill fall time from wheel to piezo
+#define SIM_FALL_MAX_US   400000
+
+int firmware_main(void);
+
+// Device running on this thread; each boot gets a fresh thread so the
+// firmware's DEVICE_LOCAL state starts from its initial values, like a reset
+static _Thread_local sim_device_t *dev_;
+
+static const uint8_t seq_halfstep[8] = {
+    0b0001, 0b0011, 0b0010, 0b0110, 0b0100, 0b1100, 0b1000, 0b1001
+};
+static const uint8_t wheel_pins[WHEEL_COUNT][4] = WHEEL_STEPPER_PINS;
+static const uint8_t opto_pins[WHEEL_COUNT] = WHEEL_OPTO_PINS;
+static const uint8_t piezo_pins[WHEEL_COUNT] = WHEEL_PIEZO_PINS;
+
+struct i2c_inst { int unused; };
+struct uart_inst { int unused; };
+static struct i2c_inst i2c_insts[2];
+static struct uart_inst uart_insts[2];
+i2c_inst_t *const i2c0 = &i2c_insts[0];
+i2c_inst_t *const i2c1 = &i2c_insts[1];
+uart_inst_t *const uart0 = &uart_insts[0];
+uart_inst_t *const uart1 = &uart_insts[1];
+_Thread_local clocks_hw_t sim_clocks;
+_Thread_local armv6m_scb_t sim_scb;
+
+// --- Randomness (splitmix64) ---
+
+static uint64_t rng_next(sim_device_t *d) {
+    uint64_t z = (d->rng += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static double rng_u01(sim_device_t *d) {
+    return (double)(rng_next(d) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint32_t rng_range(sim_device_t *d, uint32_t lo, uint32_t hi) {
+    return lo + (uint32_t)(rng_next(d) % (uint64_t)(hi - lo + 1));
+}
+
+static uint64_t rng_exp_us(sim_device_t *d, double mean_s) {
+    return (uint64_t)(-log(1.0 - rng_u01(d)) * mean_s * 1e6);
+}
+
+// --- Wheel mechanics ---
+
+static int64_t mod_rev(int64_t pos, uint32_t rev) {
+    int64_t m = pos % (int64_t)rev;
+    return m < 0 ? m + rev : m;
+}
+
+static void wheel_check_drop(sim_device_t *d, uint8_t w) {
+    sim_wheel_t *wh = &d->wheels[w];
+    int64_t pos = mod_rev(wh->rotor_half, wh->rev_half);
+
+    for (uint8_t k = 1; k < TOTAL_COMPARTMENTS; ++k) {
+        if (!wh->full[k]) continue;
+        int64_t centre = mod_rev(wh->hole_half + (int64_t)k * wh->rev_half / TOTAL_COMPARTMENTS, wh->rev_half);
+        int64_t dist = llabs(pos - centre);
+        if (dist > (int64_t)wh->rev_half / 2) dist = wh->rev_half - dist;
+        if (dist > (int64_t)wh->drop_tol_half) continue;
+
+        wh->full[k] = false;
+        d->stats.pills_dropped++;
+        if (d->cycle_start_us) {
+            uint64_t due = d->cycle_start_us + (uint64_t)k * d->params.dose_interval_min * 60000000ull;
+            sim_record_latency(d->latency_sink, (int64_t)(d->now_us - due));
+        }
+        if (rng_u01(d) < d->params.piezo_detect_p) {
+            d->stats.pills_detected++;
+            for (int i = 0; i < SIM_MAX_EVENTS; ++i) {
+                if (d->events[i].at_us) continue;
+                d->events[i].at_us = d->now_us + rng_range(d, SIM_FALL_MIN_US, SIM_FALL_MAX_US);
+                d->events[i].wheel = w;
+                break;
+            }
+        }
+    }
+}
+
+// Apply the coil writes made at one instant as a single step, possibly slipping
+static void wheel_commit(sim_device_t *d, uint8_t w) {
+    sim_wheel_t *wh = &d->wheels[w];
+    if (!wh->pending_move) return;
+
+    int move = wh->pending_move;
+    uint64_t dt = wh->pending_at_us - wh->last_step_us;
+    wh->pending_move = 0;
+    wh->last_step_us = wh->pending_at_us;
+
+    double slip = dt < (uint64_t)wh->min_half_step_us * (uint64_t)abs(move)
+                  ? d->params.slip_fast_p : d->params.slip_p;
+    if (rng_u01(d) < slip) {
+        d->stats.steps_slipped++;
+        return;
+    }
+    wh->rotor_half += move;
+    wheel_check_drop(d, w);
+}
+
+static void wheel_coils_changed(sim_device_t *d, uint8_t w) {
+    sim_wheel_t *wh = &d->wheels[w];
+    uint8_t mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (d->pin_out[wh->pins[i]]) mask |= (uint8_t)(1u << i);
+    }
+
+    int phase = -1;
+    for (int i = 0; i < 8; ++i) {
+        if (seq_halfstep[i] == mask) phase = i;
+    }
+    if (phase < 0) return;  // off or a transient pattern: the rotor holds
+    if (wh->phase < 0) {
+        wh->phase = (int8_t)phase;
+        return;
+    }
+
+    int delta = (phase - wh->phase + 8) % 8;
+    if (delta == 0) return;
+    // The rotor follows to the nearest equilibrium; opposite phases are a coin toss
+    int move = delta < 4 ? delta : (delta > 4 ? delta - 8 : ((rng_next(d) & 1) ? 4 : -4));
+    wh->phase = (int8_t)phase;
+
+    if (wh->pending_move && wh->pending_at_us != d->now_us) wheel_commit(d, w);
+    wh->pending_move = (int8_t)(wh->pending_move + move);
+    wh->pending_at_us = d->now_us;
+}
+
+// --- Virtual time ---
+
+static void power_cut(sim_device_t *d) {
+    d->stats.power_cuts++;
+    d->cut_torn = d->now_us < d->eeprom_busy_until;
+    if (d->cut_torn) {
+        // The page write in flight leaves undefined bytes behind
+        d->stats.cuts_during_write++;
+        uint16_t page = d->eeprom_pending_addr & (uint16_t)~(SIM_EEPROM_PAGE - 1);
+        for (uint8_t i = 0; i < d->eeprom_pending_len; ++i) {
+            uint16_t cell = page + (d->eeprom_pending_addr - page + i) % SIM_EEPROM_PAGE;
+            d->eeprom[cell] = (uint8_t)rng_next(d);
+        }
+    }
+    longjmp(d->exit_jmp, SIM_EXIT_POWER_CUT);
+}
+
+static void fire_alarm(sim_device_t *d, sim_alarm_t *a) {
+    alarm_id_t id = a->id;
+    d->in_irq = true;
+    int64_t ret = a->cb(id, a->user_data);
+    d->in_irq = false;
+    if (a->id != id) return;  // cancelled from inside the callback
+
+    if (ret > 0) a->at_us += (uint64_t)ret;
+    else if (ret < 0) a->at_us = d->now_us + (uint64_t)(-ret);
+    else a->id = 0;
+}
+
+static void fire_event(sim_device_t *d, sim_event_t *e) {
+    uint8_t pin = d->wheels[e->wheel].piezo_pin;
+    e->at_us = 0;
+    if (d->irq_cb && d->irq_enabled[pin]) {
+        d->in_irq = true;
+        d->irq_cb(pin, GPIO_IRQ_EDGE_FALL);
+        d->in_irq = false;
+    }
+}
+
+// Earliest pending alarm, pill or supply event at or before limit (0 = none)
+static uint64_t next_wake_us(sim_device_t *d, uint64_t limit) {
+    uint64_t t = 0;
+    for (int i = 0; i < SIM_MAX_ALARMS; ++i) {
+        if (d->alarms[i].id && d->alarms[i].at_us <= limit && (!t || d->alarms[i].at_us < t)) t = d->alarms[i].at_us;
+    }
+    for (int i = 0; i < SIM_MAX_EVENTS; ++i) {
+        if (d->events[i].at_us && d->events[i].at_us <= limit && (!t || d->events[i].at_us < t)) t = d->events[i].at_us;
+    }
+    if (d->next_cut_us && d->next_cut_us <= limit && (!t || d->next_cut_us < t)) t = d->next_cut_us;
+    if (d->params.horizon_us <= limit && (!t || d->params.horizon_us < t)) t = d->params.horizon_us;
+    return t;
+}
+
+static void advance_to(uint64_t target) {
+    sim_device_t *d = dev_;
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) wheel_commit(d, w);
+    if (d->in_irq) {
+        // Callbacks don't sleep on hardware; just let the clock move
+        if (target > d->now_us) d->now_us = target;
+        return;
+    }
+
+    for (;;) {
+        uint64_t t = next_wake_us(d, target);
+        if (!t) break;
+        if (t > d->now_us) d->now_us = t;
+
+        if (d->next_cut_us && d->next_cut_us <= t) power_cut(d);
+        if (d->params.horizon_us <= t) longjmp(d->exit_jmp, SIM_EXIT_HORIZON);
+
+        for (int i = 0; i < SIM_MAX_ALARMS; ++i) {
+            if (d->alarms[i].id && d->alarms[i].at_us <= t) fire_alarm(d, &d->alarms[i]);
+        }
+        for (int i = 0; i < SIM_MAX_EVENTS; ++i) {
+            if (d->events[i].at_us && d->events[i].at_us <= t) fire_event(d, &d->events[i]);
+        }
+    }
+    if (target > d->now_us) d->now_us = target;
+}
+
+// Sleep until something happens; with nothing pending the device idles to the horizon
+static void idle_until_wake(void) {
+    sim_device_t *d = dev_;
+    uint64_t t = next_wake_us(d, UINT64_MAX);
+    advance_to(t ? t : d->now_us + SIM_POLL_US);
+}
+
+static uint64_t since_boot_us(void) {
+    advance_to(dev_->now_us + SIM_POLL_US);
+    return dev_->now_us - dev_->boot_us;
+}
+
+absolute_time_t get_absolute_time(void) { return since_boot_us(); }
+uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000); }
+absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) { return t + (uint64_t)ms * 1000; }
+uint32_t time_us_32(void) { return (uint32_t)since_boot_us(); }
+uint64_t time_us_64(void) { return since_boot_us(); }
+void sleep_us(uint64_t us) { advance_to(dev_->now_us + us); }
+void sleep_ms(uint32_t ms) { advance_to(dev_->now_us + (uint64_t)ms * 1000); }
+void tight_loop_contents(void) { idle_until_wake(); }
+
+uint32_t save_and_disable_interrupts(void) { return 0; }
+void restore_interrupts(uint32_t status) { (void)status; }
+void __wfi(void) { idle_until_wake(); }
+
+void __wfe(void) {
+    if (dev_->on_core1) longjmp(dev_->core1_park, 1);
+    idle_until_wake();
+}
+
+// --- Alarms ---
+
+alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    sim_device_t *d = dev_;
+    uint64_t at = d->boot_us + time;
+    while (at <= d->now_us) {
+        if (!fire_if_past) return 0;
+        int64_t ret = callback(0, user_data);
+        if (!ret) return 0;
+        at = ret > 0 ? at + (uint64_t)ret : d->now_us + (uint64_t)(-ret);
+    }
+    for (int i = 0; i < SIM_MAX_ALARMS; ++i) {
+        sim_alarm_t *a = &d->alarms[i];
+        if (a->id) continue;
+        a->id = ++d->next_alarm_id;
+        a->at_us = at;
+        a->cb = callback;
+        a->user_data = user_data;
+        return a->id;
+    }
+    return PICO_ERROR_GENERIC;
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    return add_alarm_at(dev_->now_us - dev_->boot_us + us, callback, user_data, fire_if_past);
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    return add_alarm_in_us((uint64_t)ms * 1000, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t alarm_id) {
+    for (int i = 0; i < SIM_MAX_ALARMS; ++i) {
+        if (dev_->alarms[i].id == alarm_id) {
+            dev_->alarms[i].id = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+// --- GPIO, buttons and sensors ---
+
+static int stepper_wheel(uint gpio) {
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        for (int i = 0; i < 4; ++i) {
+            if (wheel_pins[w][i] == gpio) return w;
+        }
+    }
+    return -1;
+}
+
+static void operator_saw_press(sim_device_t *d, uint pin) {
+    if (pin == PIN_BTN_CAL) {
+        if (!d->cal_pressed_us) d->cal_pressed_us = d->now_us;
+    } else if (pin == PIN_BTN_START) {
+        // The operator loads the wheels right before starting a cycle
+        for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+            for (uint8_t k = 1; k < TOTAL_COMPARTMENTS; ++k) {
+                if (!d->wheels[w].full[k]) d->stats.pills_loaded++;
+                d->wheels[w].full[k] = true;
+            }
+        }
+        d->stats.cycles_started++;
+        d->cycle_start_us = d->now_us;
+    }
+}
+
+// The operator reacts to whichever button the firmware is polling
+static bool button_level(sim_device_t *d, uint pin) {
+    if (d->press_pin != (int8_t)pin) {
+        if (pin == PIN_BTN_START && d->cal_pressed_us) {
+            uint64_t took = d->now_us - d->cal_pressed_us;
+            d->stats.calibrations++;
+            d->stats.calibration_us_total += took;
+            if (took > d->stats.calibration_us_max) d->stats.calibration_us_max = took;
+            d->cal_pressed_us = 0;
+        }
+        double mean = pin == PIN_BTN_CAL ? d->params.refill_mean_s : d->params.start_mean_s;
+        d->press_pin = (int8_t)pin;
+        d->press_at_us = d->now_us + rng_exp_us(d, mean);
+        d->press_seen = false;
+    }
+    if (d->now_us < d->press_at_us) return true;
+    if (d->now_us >= d->press_at_us + SIM_PRESS_US) {
+        d->press_pin = -1;  // released; the next poll schedules a new press
+        return true;
+    }
+    if (!d->press_seen) {
+        d->press_seen = true;
+        operator_saw_press(d, pin);
+    }
+    return false;  // active low
+}
+
+void gpio_init(uint gpio) { dev_->pin_out[gpio] = false; }
+void gpio_set_dir(uint gpio, bool out) { (void)gpio; (void)out; }
+void gpio_pull_up(uint gpio) { (void)gpio; }
+void gpio_set_function(uint gpio, int fn) { (void)gpio; (void)fn; }
+
+void gpio_put(uint gpio, bool value) {
+    dev_->pin_out[gpio] = value;
+    int w = stepper_wheel(gpio);
+    if (w >= 0) wheel_coils_changed(dev_, (uint8_t)w);
+}
+
+bool gpio_get(uint gpio) {
+    sim_device_t *d = dev_;
+    if (gpio == PIN_BTN_CAL || gpio == PIN_BTN_START) return button_level(d, gpio);
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        sim_wheel_t *wh = &d->wheels[w];
+        if (gpio == wh->opto_pin) {
+            wheel_commit(d, w);
+            return mod_rev(wh->rotor_half, wh->rev_half) >= wh->hole_half;  // low at the opening
+        }
+        if (gpio == wh->piezo_pin) return true;
+    }
+    return d->pin_out[gpio];
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled) {
+    (void)events;
+    dev_->irq_enabled[gpio] = enabled;
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback) {
+    dev_->irq_cb = callback;
+    gpio_set_irq_enabled(gpio, events, enabled);
+}
+
+// --- I2C EEPROM (24Cxx: 2-byte address, page writes wrap within the page) ---
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) {
+    (void)i2c;
+    return baudrate;
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+    (void)i2c; (void)nostop;
+    sim_device_t *d = dev_;
+    if (addr != EEPROM_ADDR || len < 2) return PICO_ERROR_GENERIC;
+    if (d->now_us < d->eeprom_busy_until) return PICO_ERROR_GENERIC;  // NACK while writing
+
+    d->eeprom_ptr = (uint16_t)(((src[0] << 8) | src[1]) % SIM_EEPROM_SIZE);
+    if (len == 2) return 2;
+
+    uint16_t page = d->eeprom_ptr & (uint16_t)~(SIM_EEPROM_PAGE - 1);
+    size_t n = len - 2;
+    for (size_t i = 0; i < n; ++i) {
+        uint16_t cell = page + (d->eeprom_ptr - page + i) % SIM_EEPROM_PAGE;
+        d->eeprom[cell] = src[2 + i];
+        d->stats.cell_writes[cell]++;
+    }
+    d->eeprom_pending_addr = d->eeprom_ptr;
+    d->eeprom_pending_len = (uint8_t)(n < SIM_EEPROM_PAGE ? n : SIM_EEPROM_PAGE);
+    d->eeprom_busy_until = d->now_us + SIM_EEPROM_TWC_US;
+    d->stats.eeprom_writes++;
+    return (int)len;
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+    (void)i2c; (void)nostop;
+    sim_device_t *d = dev_;
+    if (addr != EEPROM_ADDR) return PICO_ERROR_GENERIC;
+    if (d->now_us < d->eeprom_busy_until) return PICO_ERROR_GENERIC;
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = d->eeprom[d->eeprom_ptr];
+        d->eeprom_ptr = (uint16_t)((d->eeprom_ptr + 1) % SIM_EEPROM_SIZE);
+    }
+    return (int)len;
+}
+
+// --- stdio and multicore ---
+
+bool stdio_init_all(void) { return true; }
+bool stdio_usb_connected(void) { return false; }
+
+// No host on the link: the protocol never sees a byte and its frames go nowhere
+int getchar_timeout_us(uint32_t timeout_us) { (void)timeout_us; return PICO_ERROR_TIMEOUT; }
+int stdio_put_string(const char *s, int len, bool newline, bool cr_translation) {
+    (void)s; (void)newline; (void)cr_translation;
+    return len;
+}
+
+int sim_printf(const char *fmt, ...) {
+    if (!dev_ || !dev_->trace) return 0;
+    va_list ap;
+    va_start(ap, fmt);
+    printf("[dev %u %10.3f s] ", dev_->id, (double)dev_->now_us / 1e6);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    dev_->on_core1 = true;
+    if (setjmp(dev_->core1_park) == 0) entry();
+    dev_->on_core1 = false;
+}
+
+void multicore_reset_core1(void) {}
+
+void multicore_fifo_push_blocking(uint32_t data) {
+    if (dev_->fifo_count < 4) dev_->fifo[dev_->fifo_count++] = data;
+}
+
+uint32_t multicore_fifo_pop_blocking(void) {
+    sim_device_t *d = dev_;
+    if (!d->fifo_count) {
+        fprintf(stderr, "dev %u: FIFO pop with core1 parked and FIFO empty\n", d->id);
+        abort();
+    }
+    uint32_t v = d->fifo[0];
+    memmove(d->fifo, d->fifo + 1, --d->fifo_count * sizeof(uint32_t));
+    return v;
+}
+
+// --- Device lifecycle ---
+
+void sim_device_init(sim_device_t *dev, uint32_t id, uint64_t seed, const sim_params_t *params) {
+    memset(dev, 0, sizeof(*dev));
+    dev->id = id;
+    dev->rng = seed ^ ((uint64_t)id * 0xD1B54A32D192ED03ull);
+    dev->params = *params;
+    dev->press_pin = -1;
+    if (params->cut_mean_hours > 0) dev->next_cut_us = rng_exp_us(dev, params->cut_mean_hours * 3600.0);
+
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        sim_wheel_t *wh = &dev->wheels[w];
+        memcpy(wh->pins, wheel_pins[w], sizeof(wh->pins));
+        wh->opto_pin = opto_pins[w];
+        wh->piezo_pin = piezo_pins[w];
+        wh->rev_half = rng_range(dev, 4060, 4100);          // 28BYJ-48 gearing is not exactly 4096
+        wh->hole_half = rng_range(dev, 40, 80);
+        wh->drop_tol_half = wh->rev_half / 40;
+        wh->min_half_step_us = rng_range(dev, 800, 1300);
+        wh->phase = -1;
+        wh->rotor_half = rng_range(dev, 0, wh->rev_half - 1);
+    }
+
+    // Factory image: erased EEPROM plus a default record carrying the dose schedule
+    memset(dev->eeprom, 0xFF, sizeof(dev->eeprom));
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        state_init_defaults(w);
+        if (w == 0) {
+            for (uint8_t i = 0; i < DISPENSE_SLOTS; ++i) g_states[0].dose_interval_min[i] = params->dose_interval_min;
+        }
+        memcpy(dev->eeprom + EEPROM_STATE_ADDR + w * EEPROM_STATE_SIZE, &g_states[w], sizeof(nv_state_t));
+    }
+}
+
+static void classify_recovery(sim_device_t *d) {
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        nv_state_t rec;
+        memcpy(&rec, d->eeprom + EEPROM_STATE_ADDR + w * EEPROM_STATE_SIZE, sizeof(rec));
+        if (rec.magic != STATE_MAGIC || rec.version != STATE_VERSION) {
+            d->stats.recover_defaults++;
+            continue;
+        }
+        if (d->cut_torn) d->stats.recover_torn_valid++;
+        if (rec.motor_in_progress) d->stats.recover_mid_turn++;
+        else d->stats.recover_clean++;
+    }
+    d->cut_torn = false;
+}
+
+sim_exit_t sim_device_boot(sim_device_t *dev) {
+    dev_ = dev;
+    memset(dev->pin_out, 0, sizeof(dev->pin_out));
+    memset(dev->irq_enabled, 0, sizeof(dev->irq_enabled));
+    memset(dev->alarms, 0, sizeof(dev->alarms));
+    memset(dev->events, 0, sizeof(dev->events));  // pills still falling go unseen
+    dev->irq_cb = NULL;
+    dev->fifo_count = 0;
+    dev->on_core1 = false;
+    dev->in_irq = false;
+    dev->eeprom_busy_until = 0;
+    dev->press_pin = -1;
+    dev->boot_us = dev->now_us;
+    dev->stats.boots++;
+    if (dev->stats.boots > 1) classify_recovery(dev);
+
+    int r = setjmp(dev->exit_jmp);
+    if (r == 0) {
+        firmware_main();
+        r = SIM_EXIT_HORIZON;
+    }
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        for (int i = 0; i < 4; ++i) dev->pin_out[dev->wheels[w].pins[i]] = false;
+    }
+    dev_ = NULL;
+    return (sim_exit_t)r;
+}
+
+void sim_device_power_off(sim_device_t *dev) {
+    dev->now_us += rng_exp_us(dev, dev->params.downtime_mean_s);
+    dev->cal_pressed_us = 0;
+    if (dev->params.cut_mean_hours > 0) {
+        dev->next_cut_us = dev->now_us + rng_exp_us(dev, dev->params.cut_mean_hours * 3600.0);
+    }
+}
+
+void sim_device_finish(sim_device_t *dev) {
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        nv_state_t rec;
+        memcpy(&rec, dev->eeprom + EEPROM_STATE_ADDR + w * EEPROM_STATE_SIZE, sizeof(rec));
+        if (rec.magic != STATE_MAGIC || rec.version != STATE_VERSION) continue;
+        dev->stats.fw_dispensed += rec.pills_dispensed_count;
+        dev->stats.fw_missed += rec.pills_missed_count;
+    }
+}
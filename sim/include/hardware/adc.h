@@ -0,0 +1,4 @@
+#ifndef SIM_HARDWARE_ADC_H
+#define SIM_HARDWARE_ADC_H
+#include "pico/stdlib.h"
+#endif
@@ -0,0 +1,25 @@
+#ifndef SIM_HARDWARE_CLOCKS_H
+#define SIM_HARDWARE_CLOCKS_H
+#include <stdint.h>
+
+// Only the sleep enables are modelled and the simulator gates nothing, so the bit
+// values just need to be distinct
+typedef struct {
+    uint32_t sleep_en0;
+    uint32_t sleep_en1;
+} clocks_hw_t;
+
+extern _Thread_local clocks_hw_t sim_clocks;
+#define clocks_hw (&sim_clocks)
+
+#define CLOCKS_SLEEP_EN0_CLK_SYS_IO_BITS        0x00040000u
+#define CLOCKS_SLEEP_EN0_CLK_SYS_PADS_BITS      0x00100000u
+#define CLOCKS_SLEEP_EN0_CLK_SYS_PLL_USB_BITS   0x00800000u
+#define CLOCKS_SLEEP_EN1_CLK_SYS_TIMER_BITS     0x00000200u
+#define CLOCKS_SLEEP_EN1_CLK_SYS_WATCHDOG_BITS  0x00000800u
+#define CLOCKS_SLEEP_EN1_CLK_SYS_USBCTRL_BITS   0x00001000u
+#define CLOCKS_SLEEP_EN1_CLK_USB_USBCTRL_BITS   0x00002000u
+#define CLOCKS_SLEEP_EN1_CLK_SYS_UART0_BITS     0x00000040u
+#define CLOCKS_SLEEP_EN1_CLK_PERI_UART0_BITS    0x00000020u
+
+#endif
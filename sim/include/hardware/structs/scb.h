@@ -0,0 +1,14 @@
+#ifndef SIM_HARDWARE_STRUCTS_SCB_H
+#define SIM_HARDWARE_STRUCTS_SCB_H
+#include <stdint.h>
+
+typedef struct {
+    uint32_t scr;
+} armv6m_scb_t;
+
+extern _Thread_local armv6m_scb_t sim_scb;
+#define scb_hw (&sim_scb)
+
+#define M0PLUS_SCR_SLEEPDEEP_BITS 0x00000004u
+
+#endif
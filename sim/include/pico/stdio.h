@@ -0,0 +1,10 @@
+#ifndef SIM_PICO_STDIO_H
+#define SIM_PICO_STDIO_H
+#include <stdbool.h>
+#include <stdint.h>
+
+bool stdio_init_all(void);
+int getchar_timeout_us(uint32_t timeout_us);
+int stdio_put_string(const char *s, int len, bool newline, bool cr_translation);
+
+#endif
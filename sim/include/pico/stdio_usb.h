@@ -0,0 +1,7 @@
+#ifndef SIM_PICO_STDIO_USB_H
+#define SIM_PICO_STDIO_USB_H
+#include <stdbool.h>
+
+bool stdio_usb_connected(void);
+
+#endif
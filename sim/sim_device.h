@@ -0,0 +1,161 @@
+#ifndef SIM_DEVICE_H
+#define SIM_DEVICE_H
+// One simulated dispenser: virtual clock, EEPROM, wheel mechanics, operator
+// and power supply. The firmware reaches it through the SDK stand-ins in
+// hal_sim.c; fleet_sim.cpp owns the devices and the statistics.
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "pico/stdlib.h"
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIM_GPIO_COUNT     30
+#define SIM_EEPROM_SIZE    4096   // 24C32
+#define SIM_EEPROM_PAGE    32
+#define SIM_MAX_ALARMS     16     // default alarm pool size in the SDK
+#define SIM_MAX_EVENTS     (WHEEL_COUNT * TOTAL_COMPARTMENTS)
+
+typedef enum {
+    SIM_EXIT_POWER_CUT = 1,
+    SIM_EXIT_HORIZON,
+} sim_exit_t;
+
+// Fleet-wide knobs; every device draws its own variation from them
+typedef struct {
+    uint64_t horizon_us;          // simulated operating time per device
+    uint16_t dose_interval_min;   // provisioned into wheel 0's record
+    double cut_mean_hours;        // mean time between power cuts (0 = never)
+    double downtime_mean_s;       // mean time a cut keeps the device off
+    double refill_mean_s;         // operator delay before pressing CAL
+    double start_mean_s;          // operator delay before pressing START
+    double piezo_detect_p;        // chance a dropped pill triggers the piezo
+    double slip_p;                // chance a step is lost at a safe rate
+    double slip_fast_p;           // chance a step is lost above the motor's limit
+} sim_params_t;
+
+typedef struct {
+    alarm_id_t id;                // 0 = free
+    uint64_t at_us;
+    alarm_callback_t cb;
+    void *user_data;
+} sim_alarm_t;
+
+typedef struct {
+    uint64_t at_us;               // 0 = free
+    uint8_t wheel;
+} sim_event_t;
+
+typedef struct {
+    uint8_t pins[4];
+    uint8_t opto_pin;
+    uint8_t piezo_pin;
+
+    uint32_t rev_half;            // actual half-steps per wheel revolution
+    uint32_t hole_half;           // opto opening width
+    uint32_t drop_tol_half;       // how far off-centre a compartment still drops
+    uint32_t min_half_step_us;    // fastest the rotor follows without slipping
+
+    int8_t phase;                 // last energised phase, -1 = unknown
+    int64_t rotor_half;           // physical position, persists across boots
+    uint64_t last_step_us;
+    int8_t pending_move;          // coil writes at one instant form a single step
+    uint64_t pending_at_us;
+    bool full[TOTAL_COMPARTMENTS];
+} sim_wheel_t;
+
+// Per-device results, merged by the fleet tool
+typedef struct {
+    uint32_t boots;
+    uint32_t power_cuts;
+    uint32_t cuts_during_write;   // cut landed inside an EEPROM write cycle
+    uint32_t recover_clean;       // valid record, no motion in progress
+    uint32_t recover_mid_turn;    // valid record with motor_in_progress set
+    uint32_t recover_defaults;    // bad magic/version: progress lost
+    uint32_t recover_torn_valid;  // torn write that still passed magic/version
+
+    uint32_t cycles_started;
+    uint32_t pills_loaded;
+    uint32_t pills_dropped;
+    uint32_t pills_detected;
+    uint32_t steps_slipped;
+
+    uint32_t calibrations;
+    uint64_t calibration_us_total;
+    uint64_t calibration_us_max;
+
+    uint32_t fw_dispensed;        // firmware counters read back at the end
+    uint32_t fw_missed;
+
+    uint64_t eeprom_writes;       // I2C page writes
+    uint32_t cell_writes[SIM_EEPROM_SIZE];
+} sim_stats_t;
+
+typedef struct sim_device {
+    uint32_t id;
+    uint64_t rng;
+    sim_params_t params;
+
+    // Clock: now_us runs across boots, firmware time is relative to boot_us
+    uint64_t now_us;
+    uint64_t boot_us;
+    uint64_t next_cut_us;         // 0 = no cut scheduled
+    bool cut_torn;                // last cut interrupted an EEPROM write
+    jmp_buf exit_jmp;
+    bool in_irq;
+
+    // Peripherals, cleared on every boot
+    bool pin_out[SIM_GPIO_COUNT];
+    bool irq_enabled[SIM_GPIO_COUNT];
+    gpio_irq_callback_t irq_cb;
+    sim_alarm_t alarms[SIM_MAX_ALARMS];
+    alarm_id_t next_alarm_id;
+    sim_event_t events[SIM_MAX_EVENTS];
+    uint32_t fifo[4];
+    uint8_t fifo_count;
+    bool on_core1;
+    jmp_buf core1_park;
+
+    // EEPROM survives power cuts, except a write cycle in flight
+    uint8_t eeprom[SIM_EEPROM_SIZE];
+    uint16_t eeprom_ptr;
+    uint64_t eeprom_busy_until;
+    uint16_t eeprom_pending_addr;
+    uint8_t eeprom_pending_len;
+
+    sim_wheel_t wheels[WHEEL_COUNT];
+
+    // Operator: presses the button the firmware is polling, after a delay
+    int8_t press_pin;             // -1 = none scheduled
+    uint64_t press_at_us;
+    bool press_seen;              // the firmware has read this press
+    uint64_t cal_pressed_us;      // 0 = not calibrating
+    uint64_t cycle_start_us;
+
+    sim_stats_t stats;
+    void *latency_sink;           // owned by fleet_sim.cpp
+    bool trace;
+} sim_device_t;
+
+void sim_device_init(sim_device_t *dev, uint32_t id, uint64_t seed, const sim_params_t *params);
+
+// Run the firmware from power-on until the next power cut or the horizon
+sim_exit_t sim_device_boot(sim_device_t *dev);
+
+// Keep the device unpowered for a random downtime
+void sim_device_power_off(sim_device_t *dev);
+
+// Read the firmware's own counters back out of the simulated EEPROM
+void sim_device_finish(sim_device_t *dev);
+
+// Implemented by the fleet tool: dose due time to pill drop, in microseconds
+void sim_record_latency(void *sink, int64_t latency_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
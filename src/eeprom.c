@@ -25,6 +25,9 @@ bool eeprom_write(uint16_t addr, const uint8_t *buf, size_t len) {
         uint16_t a = addr + written;
         size_t chunk = len - written;
         if (chunk > 16) chunk = 16;
+        // Never cross a page boundary, or the tail would overwrite the start of the page
+        size_t to_page_end = EEPROM_PAGE_SIZE - (a % EEPROM_PAGE_SIZE);
+        if (chunk > to_page_end) chunk = to_page_end;
 
         uint8_t tmp[18];
         tmp[0] = (uint8_t)(a >> 8);
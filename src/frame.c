@@ -0,0 +1,44 @@
+#include "frame.h"
+
+uint16_t frame_crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; ++b) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+size_t cobs_encode(const uint8_t *src, size_t len, uint8_t *dst) {
+    size_t out = 1, code_at = 0;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; ++i) {
+        if (src[i] != 0) {
+            dst[out++] = src[i];
+            code++;
+        }
+        if (src[i] == 0 || code == 0xFF) {
+            dst[code_at] = code;
+            code = 1;
+            code_at = out++;
+        }
+    }
+    dst[code_at] = code;
+    return out;
+}
+
+size_t cobs_decode(const uint8_t *src, size_t len, uint8_t *dst) {
+    size_t in = 0, out = 0;
+    while (in < len) {
+        uint8_t code = src[in++];
+        if (code == 0 || in + code - 1 > len) return 0;
+        for (uint8_t i = 1; i < code; ++i) {
+            if (src[in] == 0) return 0;
+            dst[out++] = src[in++];
+        }
+        if (code != 0xFF && in < len) dst[out++] = 0;
+    }
+    return out;
+}
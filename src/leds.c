@@ -2,6 +2,8 @@
 #include "hardware/gpio.h"
 #include "config.h"
 #include "leds.h"
+#include "proto.h"
+#include "util.h"
 
 void leds_init(void) {
     gpio_init(PIN_LED1); gpio_set_dir(PIN_LED1, GPIO_OUT);
@@ -17,8 +19,8 @@ void leds_all_off(void) {
 }
 
 void leds_wait_blink(void) {
-    static uint32_t t = 0;
-    static bool on = false;
+    static DEVICE_LOCAL uint32_t t = 0;
+    static DEVICE_LOCAL bool on = false;
     if (time_us_32() - t > 500000) { // 0.5s
         on = !on;
         gpio_put(PIN_LED1, on);
@@ -34,12 +36,21 @@ void leds_on_ready(void) {
     gpio_put(PIN_LED3, 0);
 }
 
+// The error blink holds the main loop for over a second; keep answering the link
+static void blink_pause_ms(uint32_t ms) {
+    uint32_t t0 = now_ms();
+    while (now_ms() - t0 < ms) {
+        proto_service();
+        sleep_ms(1);
+    }
+}
+
 void leds_blink_error(uint8_t times) {
     for (uint8_t i = 0; i < times; ++i) {
         gpio_put(PIN_LED3, 1);
-        sleep_ms(150);
+        blink_pause_ms(150);
         gpio_put(PIN_LED3, 0);
-        sleep_ms(150);
+        blink_pause_ms(150);
     }
 }
 
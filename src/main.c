@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "pico/stdlib.h"
+#include "pico/stdio_usb.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
 #include "config.h"
 #include "state.h"
 #include "stepper.h"
@@ -8,47 +11,146 @@
 #include "eeprom.h"
 #include "leds.h"
 #include "buttons.h"
+#include "schedule.h"
+#include "proto.h"
 #include "util.h"
 
-extern nv_state_t g_state;
+static DEVICE_LOCAL stepper_t wheels[WHEEL_COUNT];
 
 // Recovery after power loss
-static void safe_recover_if_mid_turn(void) {
-    if (g_state.motor_in_progress) {
-        printf("(RECOVERY) Power loss detected mid-turn. Resuming without rotation.\n");
-        g_state.motor_in_progress = false;
-        state_save();
-        printf("(RECOVERY) Resume from slot=%u, calibrated=%d, sps=%u\n",
-               g_state.current_slot, g_state.calibrated, g_state.steps_per_slot);
+static void safe_recover_if_mid_turn(uint8_t w) {
+    nv_state_t *st = &g_states[w];
+    if (st->motor_in_progress) {
+        printf("(RECOVERY) Wheel %u: power loss detected mid-turn. Resuming without rotation.\n", w);
+        st->motor_in_progress = false;
+        STATE_SAVE_FIELD(w, motor_in_progress);
+        printf("(RECOVERY) Wheel %u resume from slot=%u, calibrated=%d, sps=%u\n",
+               w, st->current_slot, st->calibrated, st->steps_per_slot);
     }
 }
 
+static bool all_wheels_calibrated(void) {
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        if (!g_states[w].calibrated) return false;
+    }
+    return true;
+}
+
+// Wheels advance in lockstep; after a power cut some may be one dose ahead
+static uint8_t next_dose(void) {
+    uint8_t dose = DISPENSE_SLOTS;
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        if (g_states[w].dispenses_done < dose) dose = g_states[w].dispenses_done;
+    }
+    return dose;
+}
+
+// Start every due wheel, then let them all move at once
+static void advance_due_wheels(const bool due[WHEEL_COUNT]) {
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        if (!due[w]) continue;
+        stepper_mark_motion_begin(&wheels[w]);
+        stepper_set_mode(&wheels[w], STEPPER_SLOT_MODE);
+        stepper_advance_one_slot_async(&wheels[w]);
+    }
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        if (!due[w]) continue;
+        stepper_wait(&wheels[w]);
+        stepper_mark_motion_end(&wheels[w]);
+        slot_advance(&wheels[w]);
+    }
+}
+
+// Boot timing: each phase is timed from the end of the previous one
+#define BOOT_MAX_PHASES 8
+static DEVICE_LOCAL struct { const char *name; uint32_t us; } boot_phases[BOOT_MAX_PHASES];
+static DEVICE_LOCAL uint8_t boot_phase_count = 0;
+static DEVICE_LOCAL uint32_t boot_phase_start_us = 0;
+static DEVICE_LOCAL uint32_t boot_core1_storage_us = 0;
+static DEVICE_LOCAL bool boot_reported = false;
+
+static void boot_mark(const char *name) {
+    uint32_t t = time_us_32();
+    if (boot_phase_count < BOOT_MAX_PHASES) {
+        boot_phases[boot_phase_count].name = name;
+        boot_phases[boot_phase_count].us = t - boot_phase_start_us;
+        boot_phase_count++;
+    }
+    boot_phase_start_us = t;
+}
+
+// USB enumerates in the background, so the report waits for a host (or the timeout)
+static void boot_report_poll(void) {
+    if (boot_reported) return;
+    if (!stdio_usb_connected() && now_ms() < BOOT_REPORT_TIMEOUT_MS) return;
+    boot_reported = true;
+
+    printf("Hello from Pill dispenser\n");
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < boot_phase_count; ++i) {
+        printf("(BOOT) %-8s %6u us\n", boot_phases[i].name, boot_phases[i].us);
+        total += boot_phases[i].us;
+    }
+    printf("(BOOT) EEPROM load on core1 took %u us\n", boot_core1_storage_us);
+    printf("(BOOT) boot #%u, first decision after %u us\n", g_states[0].boots_count, total);
+}
+
+// Core1 boot work: EEPROM over I2C is the slow part, so it overlaps GPIO init on core0
+static void core1_boot_storage(void) {
+    uint32_t t = time_us_32();
+    eeprom_init();
+    uint32_t stored_mask = 0;
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        if (state_load(w)) stored_mask |= 1u << w;
+    }
+    multicore_fifo_push_blocking(stored_mask);
+    multicore_fifo_push_blocking(time_us_32() - t);
+    while (true) __wfe();
+}
+
 int main() {
+    boot_phase_start_us = time_us_32();
     stdio_init_all();
-    sensors_init();
-    sleep_ms(2000);
     setvbuf(stdout, NULL, _IONBF, 0);
+    boot_mark("stdio");
 
-    printf("Hello from Pill dispenser\n");
+    multicore_launch_core1(core1_boot_storage);
+    leds_init();
+    buttons_init();
+    sensors_init();
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        stepper_init(&wheels[w], w);
+    }
+    schedule_init();
+    boot_mark("gpio");
 
-    leds_init();      printf("(INIT) LEDs initialized.\n");
-    buttons_init();   printf("(INIT) Buttons initialized.\n");
-    sensors_init();   printf("(INIT) Sensors initialized.\n");
-    stepper_init();   printf("(INIT) Stepper initialized.\n");
-    eeprom_init();    printf("(INIT) EEPROM initialized.\n");
+    uint32_t stored_mask = multicore_fifo_pop_blocking();
+    boot_core1_storage_us = multicore_fifo_pop_blocking();
+    multicore_reset_core1();
+    boot_mark("storage");
 
-    state_load();
-    g_state.boots_count++;
-    state_save();
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        g_states[w].boots_count++;
+        if (stored_mask & (1u << w)) {
+            STATE_SAVE_FIELD(w, boots_count);
+        } else {
+            state_save(w); // first boot or bad record: persist the defaults
+        }
+    }
+    boot_mark("state");
 
-    safe_recover_if_mid_turn();
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        safe_recover_if_mid_turn(w);
+        slot_set(&wheels[w], g_states[w].current_slot);
+    }
 
     // System state machine
     system_state_t sys;
-    if (g_state.calibrated) {
-        if (g_state.dispenses_done < DISPENSE_SLOTS) {
+    if (all_wheels_calibrated()) {
+        if (next_dose() < DISPENSE_SLOTS) {
             sys = SYS_DISPENSING;
-            printf("(RECOVERY) Continuing dispensing from slot=%u\n", g_state.current_slot);
+            schedule_resume();
+            printf("(RECOVERY) Continuing dispensing from pill number %u\n", next_dose() + 1);
         } else {
             sys = SYS_READY_TO_START;
             printf("(RECOVERY) Cycle complete, ready to start new dispensing.\n");
@@ -57,12 +159,15 @@ int main() {
         sys = SYS_WAIT_CAL_BUTTON;
         printf("(ACTION) Press CAL button to start wheel calibration.\n");
     }
+    boot_mark("decide");
 
     while (true) {
+        boot_report_poll();
+        proto_action_t action = proto_poll(sys);
         switch (sys) {
             case SYS_WAIT_CAL_BUTTON: {
                 leds_wait_blink();
-                if (button_cal_pressed()) {
+                if (action == PROTO_ACTION_CALIBRATE || button_cal_pressed()) {
                     sys = SYS_CALIBRATING;
                     printf("(EVENT) Calibration button pressed.\n");
                 }
@@ -70,19 +175,29 @@ int main() {
             }
 
             case SYS_CALIBRATING: {
-                stepper_mark_motion_begin();
-                uint32_t rev1 = stepper_calibrate_revolution();
-                uint32_t rev2 = stepper_calibrate_revolution();
-                stepper_mark_motion_end();
-
-                if (rev1 > 0 && rev2 > 0) {
-                    uint32_t mean = (rev1 + rev2) / 2;
-                    g_state.steps_per_slot = (uint16_t)(mean / TOTAL_COMPARTMENTS);
-                    g_state.current_slot = CALIBRATION_SLOT_INDEX;
-                    g_state.calibrated = true;
-                    g_state.dispenses_done = 0;
-                    g_state.pills_remaining = DISPENSE_SLOTS;
-                    state_save();
+                bool ok = true;
+                for (uint8_t w = 0; w < WHEEL_COUNT && ok; ++w) {
+                    stepper_t *m = &wheels[w];
+                    stepper_set_mode(m, STEPPER_CAL_MODE);
+                    stepper_mark_motion_begin(m);
+                    uint32_t rev1 = stepper_calibrate_revolution(m);
+                    uint32_t rev2 = stepper_calibrate_revolution(m);
+                    stepper_mark_motion_end(m);
+
+                    ok = rev1 > 0 && rev2 > 0;
+                    if (ok) stepper_store_calibration(m, (rev1 + rev2) / 2);
+                }
+
+                if (ok) {
+                    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+                        nv_state_t *st = &g_states[w];
+                        slot_set(&wheels[w], CALIBRATION_SLOT_INDEX);
+                        st->current_slot = CALIBRATION_SLOT_INDEX;
+                        st->calibrated = true;
+                        st->dispenses_done = 0;
+                        st->pills_remaining = DISPENSE_SLOTS;
+                        state_save(w);
+                    }
 
                     printf("(SUCCESS) Calibration complete. Press button 2 to start dispensing.\n");
                     sys = SYS_READY_TO_START;
@@ -96,79 +211,114 @@ int main() {
 
             case SYS_READY_TO_START: {
                 leds_on_ready();
-                if (button_start_pressed()) {
+                if (action == PROTO_ACTION_START || button_start_pressed()) {
                     printf("(EVENT) START button pressed.\n");
+                    schedule_start();
                     sys = SYS_DISPENSING;
                 }
                 break;
             }
 
             case SYS_DISPENSING: {
-                while (g_state.dispenses_done < DISPENSE_SLOTS) {
-                    printf("(INFO) Waiting %u seconds before next dispensing turn.\n",
-                           DISPENSE_INTERVAL_MS / 1000);
-                    uint32_t t0 = now_ms();
-                    while (now_ms() - t0 < DISPENSE_INTERVAL_MS) {
-                        tight_loop_contents();
+                while (next_dose() < DISPENSE_SLOTS) {
+                    uint8_t dose = next_dose();
+                    bool due[WHEEL_COUNT];
+                    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+                        due[w] = g_states[w].dispenses_done == dose;
                     }
 
-                    // Show which pill is being dispensed
-                    printf("(MOTION) Dispensing pill number %u...\n", g_state.dispenses_done + 1);
-
-                    stepper_mark_motion_begin();
-                    g_state.motor_in_progress = true;
-                    state_save();
+                    schedule_arm(dose);
+                    printf("(INFO) Sleeping %u seconds before next dispensing turn.\n",
+                           schedule_interval_ms(dose) / 1000);
+                    // The request may have come in at the top of the main loop, before arming
+                    while (!schedule_dose_due()) {
+                        if (action == PROTO_ACTION_DISPENSE_NOW) {
+                            printf("(EVENT) Dispense requested.\n");
+                            schedule_fire_now();
+                            break;
+                        }
+                        schedule_sleep();
+                        boot_report_poll();
+                        action = proto_poll(SYS_DISPENSING);
+                    }
+                    action = PROTO_ACTION_NONE;
 
-                    for (uint32_t i = 0; i < g_state.steps_per_slot; ++i) {
-                        stepper_step_sequence_once();
-                        sleep_us(STEPPER_STEP_DELAY_US);
+                    if (schedule_is_skipped(dose)) {
+                        // The compartment was left empty: move past it so the wheel stays on the dose count
+                        printf("(INFO) Dose %u skipped by schedule.\n", dose + 1);
+                        advance_due_wheels(due);
+                        for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+                            if (!due[w]) continue;
+                            nv_state_t *st = &g_states[w];
+                            st->dispenses_done++;
+                            if (st->pills_remaining > 0) st->pills_remaining--;
+                            state_save(w);
+                        }
+                        continue;
                     }
 
-                    stepper_mark_motion_end();
-                    g_state.motor_in_progress = false;
-                    slot_advance();
-                    state_save();
+                    // Show which pill is being dispensed
+                    printf("(MOTION) Dispensing pill number %u...\n", dose + 1);
+                    advance_due_wheels(due);
 
                     printf("(SENSOR) Waiting for pill hit...\n");
+                    bool hit[WHEEL_COUNT] = { false };
+                    uint8_t pending = 0;
+                    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+                        if (due[w]) pending++;
+                    }
                     uint32_t t1 = now_ms();
-                    bool hit = false;
-                    while (now_ms() - t1 < PIEZO_FALL_WINDOW_MS) {
-                        if (piezo_was_triggered()) {
-                            hit = true;
-                            break;
+                    while (pending > 0 && now_ms() - t1 < PIEZO_FALL_WINDOW_MS) {
+                        proto_service();
+                        for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+                            if (due[w] && !hit[w] && piezo_was_triggered(w)) {
+                                hit[w] = true;
+                                pending--;
+                            }
                         }
                     }
-                    piezo_reset_flag();
-
-                    g_state.dispenses_done++;
-                    if (hit) {
-                        g_state.pills_dispensed_count++;
-                        if (g_state.pills_remaining > 0) g_state.pills_remaining--;
-                        leds_dispense_progress(g_state.dispenses_done);
-                        state_save();
-                        printf("(SUCCESS) Pill %u detected.\n", g_state.dispenses_done);
-                    } else {
-                        g_state.pills_missed_count++;
-                        leds_blink_error(5);
-                        state_save();
-                        printf("(WARNING) Pill %u not detected.\n", g_state.dispenses_done);
+
+                    bool missed = false;
+                    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+                        if (!due[w]) continue;
+                        nv_state_t *st = &g_states[w];
+                        piezo_reset_flag(w);
+
+                        st->dispenses_done++;
+                        if (hit[w]) {
+                            st->pills_dispensed_count++;
+                            if (st->pills_remaining > 0) st->pills_remaining--;
+                            state_save(w);
+                            printf("(SUCCESS) Wheel %u pill %u detected.\n", w, st->dispenses_done);
+                        } else {
+                            st->pills_missed_count++;
+                            missed = true;
+                            state_save(w);
+                            printf("(WARNING) Wheel %u pill %u not detected.\n", w, st->dispenses_done);
+                        }
                     }
+                    if (missed) leds_blink_error(5);
+                    else leds_dispense_progress(dose + 1);
                 }
 
 
                 printf("(INFO) One full circle complete. Dispenser empty.\n");
-                g_state.calibrated = false;
-                g_state.dispenses_done = 0;
-                g_state.pills_remaining = DISPENSE_SLOTS;
-                state_save();
+                for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+                    g_states[w].calibrated = false;
+                    g_states[w].dispenses_done = 0;
+                    g_states[w].pills_remaining = DISPENSE_SLOTS;
+                    state_save(w);
+                }
                 sys = SYS_EMPTY;
                 break;
             }
 
             case SYS_EMPTY: {
                 printf("(INFO) All pills dispensed. Press button 1 to restart.\n");
-                g_state.calibrated = false;
-                state_save();
+                for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+                    g_states[w].calibrated = false;
+                    state_save(w);
+                }
                 sys = SYS_WAIT_CAL_BUTTON;
                 break;
             }
@@ -0,0 +1,224 @@
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/stdio.h"
+#include "config.h"
+#include "state.h"
+#include "eeprom.h"
+#include "frame.h"
+#include "schedule.h"
+#include "proto.h"
+#include "util.h"
+
+// Sized for the longest valid encoded frame, so a decoded frame fits PROTO_MAX_FRAME
+static DEVICE_LOCAL uint8_t rx_buf[PROTO_MAX_FRAME + PROTO_MAX_FRAME / 254 + 1];
+static DEVICE_LOCAL size_t rx_len = 0;
+static DEVICE_LOCAL bool rx_overflow = false;
+
+static DEVICE_LOCAL uint16_t telemetry_period_ms = 0;
+static DEVICE_LOCAL uint32_t telemetry_last_ms = 0;
+static DEVICE_LOCAL uint8_t telemetry_seq = 0;
+
+static DEVICE_LOCAL system_state_t last_sys = SYS_BOOT;
+static DEVICE_LOCAL bool busy = false;
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+// frame holds the header and payload; the CRC is appended here
+static void send_frame(uint8_t *frame, size_t len) {
+    uint8_t wire[PROTO_MAX_FRAME + PROTO_MAX_FRAME / 254 + 3];
+    put_u16(frame + len, frame_crc16(frame, len));
+
+    // Leading delimiter splits the frame from any text printed before it
+    wire[0] = 0;
+    size_t n = cobs_encode(frame, len + 2, wire + 1);
+    wire[n + 1] = 0;
+
+    // One write, so USB sends whole packets; no CRLF translation on binary data
+    stdio_put_string((const char *)wire, (int)(n + 2), false, false);
+}
+
+static size_t put_snapshot(uint8_t *p, system_state_t sys) {
+    put_u32(p, now_ms());
+    p[4] = (uint8_t)sys;
+    p[5] = WHEEL_COUNT;
+    uint8_t *w = p + PROTO_SNAPSHOT_HEADER;
+    for (uint8_t i = 0; i < WHEEL_COUNT; ++i, w += PROTO_SNAPSHOT_WHEEL) {
+        const nv_state_t *st = &g_states[i];
+        w[0] = st->current_slot;
+        w[1] = st->dispenses_done;
+        w[2] = st->pills_remaining;
+        w[3] = (uint8_t)((st->calibrated ? 0x1 : 0) | (st->motor_in_progress ? 0x2 : 0));
+        put_u32(w + 4, st->boots_count);
+        put_u32(w + 8, st->pills_dispensed_count);
+        put_u32(w + 12, st->pills_missed_count);
+    }
+    return PROTO_SNAPSHOT_HEADER + WHEEL_COUNT * PROTO_SNAPSHOT_WHEEL;
+}
+
+static proto_action_t handle_request(const uint8_t *req, size_t len, system_state_t sys) {
+    const uint8_t *arg = req + PROTO_HEADER_SIZE;
+    size_t arg_len = len - PROTO_HEADER_SIZE;
+    proto_action_t action = PROTO_ACTION_NONE;
+
+    uint8_t resp[PROTO_MAX_FRAME];
+    uint8_t *out = resp + PROTO_HEADER_SIZE;
+    size_t out_len = 0;
+    uint8_t status = PROTO_OK;
+
+    switch (req[2]) {
+        case PROTO_CMD_PING:
+            memcpy(out, arg, arg_len);
+            out_len = arg_len;
+            break;
+
+        case PROTO_CMD_GET_STATE:
+            if (arg_len != 1 || arg[0] >= WHEEL_COUNT) {
+                status = PROTO_ERR_ARG;
+                break;
+            }
+            memcpy(out, &g_states[arg[0]], sizeof(nv_state_t));
+            out_len = sizeof(nv_state_t);
+            break;
+
+        case PROTO_CMD_GET_COUNTERS:
+            out_len = put_snapshot(out, sys);
+            break;
+
+        case PROTO_CMD_READ_EEPROM: {
+            if (arg_len != 3 || arg[2] == 0 || arg[2] > PROTO_MAX_PAYLOAD) {
+                status = PROTO_ERR_ARG;
+                break;
+            }
+            uint16_t addr = (uint16_t)(arg[0] | (arg[1] << 8));
+            if (!eeprom_read(addr, out, arg[2])) {
+                status = PROTO_ERR_IO;
+                break;
+            }
+            out_len = arg[2];
+            break;
+        }
+
+        case PROTO_CMD_CALIBRATE:
+            if (busy) status = PROTO_ERR_BUSY;
+            else if (sys == SYS_WAIT_CAL_BUTTON) action = PROTO_ACTION_CALIBRATE;
+            else status = PROTO_ERR_STATE;
+            break;
+
+        case PROTO_CMD_START:
+            if (busy) status = PROTO_ERR_BUSY;
+            else if (sys == SYS_READY_TO_START) action = PROTO_ACTION_START;
+            else status = PROTO_ERR_STATE;
+            break;
+
+        case PROTO_CMD_DISPENSE_NOW:
+            if (busy) status = PROTO_ERR_BUSY;
+            else if (sys == SYS_DISPENSING) action = PROTO_ACTION_DISPENSE_NOW;
+            else status = PROTO_ERR_STATE;
+            break;
+
+        case PROTO_CMD_TELEMETRY:
+            if (arg_len != 2) {
+                status = PROTO_ERR_ARG;
+                break;
+            }
+            telemetry_period_ms = (uint16_t)(arg[0] | (arg[1] << 8));
+            telemetry_last_ms = now_ms();
+            break;
+
+        case PROTO_CMD_GET_SCHEDULE:
+            for (uint8_t d = 0; d < DISPENSE_SLOTS; ++d) {
+                put_u16(out + 2 * d, g_states[0].dose_interval_min[d]);
+            }
+            out[2 * DISPENSE_SLOTS] = g_states[0].dose_skip_mask;
+            out_len = 2 * DISPENSE_SLOTS + 1;
+            break;
+
+        // Applies from the next dose that is armed
+        case PROTO_CMD_SET_SCHEDULE:
+            if (arg_len != 4 || arg[0] >= DISPENSE_SLOTS || arg[3] > 1) {
+                status = PROTO_ERR_ARG;
+                break;
+            }
+            schedule_set_interval_min(arg[0], (uint16_t)(arg[1] | (arg[2] << 8)));
+            schedule_set_skip(arg[0], arg[3]);
+            break;
+
+        default:
+            status = PROTO_ERR_CMD;
+            break;
+    }
+
+    resp[0] = PROTO_KIND_RESPONSE;
+    resp[1] = req[1];
+    resp[2] = req[2];
+    resp[3] = status;
+    send_frame(resp, PROTO_HEADER_SIZE + out_len);
+    return action;
+}
+
+static proto_action_t handle_frame(system_state_t sys) {
+    uint8_t frame[PROTO_MAX_FRAME];
+    size_t len = cobs_decode(rx_buf, rx_len, frame);
+    if (len < PROTO_HEADER_SIZE + 2) return PROTO_ACTION_NONE;
+
+    len -= 2;
+    uint16_t crc = (uint16_t)(frame[len] | (frame[len + 1] << 8));
+    if (crc != frame_crc16(frame, len) || frame[0] != PROTO_KIND_REQUEST) return PROTO_ACTION_NONE;
+    return handle_request(frame, len, sys);
+}
+
+// Wakes the core from WFI so telemetry keeps flowing while waiting for a dose
+static int64_t telemetry_wake_cb(alarm_id_t id, void *user_data) {
+    (void)id; (void)user_data;
+    return 0;
+}
+
+static proto_action_t poll_link(system_state_t sys) {
+    proto_action_t action = PROTO_ACTION_NONE;
+
+    int c;
+    while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+        if (c != 0) {
+            if (rx_len < sizeof(rx_buf)) rx_buf[rx_len++] = (uint8_t)c;
+            else rx_overflow = true;
+            continue;
+        }
+        if (rx_len > 0 && !rx_overflow) {
+            proto_action_t a = handle_frame(sys);
+            if (a != PROTO_ACTION_NONE) action = a;
+        }
+        rx_len = 0;
+        rx_overflow = false;
+    }
+
+    if (telemetry_period_ms && now_ms() - telemetry_last_ms >= telemetry_period_ms) {
+        uint8_t frame[PROTO_MAX_FRAME];
+        frame[0] = PROTO_KIND_TELEMETRY;
+        frame[1] = telemetry_seq++;
+        frame[2] = PROTO_CMD_TELEMETRY;
+        frame[3] = PROTO_OK;
+        send_frame(frame, PROTO_HEADER_SIZE + put_snapshot(frame + PROTO_HEADER_SIZE, sys));
+        telemetry_last_ms = now_ms();
+        add_alarm_in_ms(telemetry_period_ms, telemetry_wake_cb, NULL, false);
+    }
+    return action;
+}
+
+proto_action_t proto_poll(system_state_t sys) {
+    last_sys = sys;
+    return poll_link(sys);
+}
+
+void proto_service(void) {
+    busy = true;
+    poll_link(last_sys);
+    busy = false;
+}
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/scb.h"
+#include "config.h"
+#include "state.h"
+#include "schedule.h"
+
+// Dose times are device-wide; they are stored in wheel 0's record
+#define SCHEDULE_STATE g_states[0]
+
+static DEVICE_LOCAL volatile bool dose_due = false;
+static DEVICE_LOCAL alarm_id_t dose_alarm = 0;
+static DEVICE_LOCAL absolute_time_t last_due;
+static DEVICE_LOCAL alarm_id_t checkpoint_alarm = 0;
+static DEVICE_LOCAL volatile uint16_t checkpoints = 0;
+static DEVICE_LOCAL bool resuming = false;
+
+#define SCHEDULE_NO_DOSE 0xFF
+
+static int64_t dose_alarm_cb(alarm_id_t id, void *user_data) {
+    (void)id; (void)user_data;
+    dose_alarm = 0;
+    dose_due = true;
+    return 0; // one-shot
+}
+
+// Only counts; the EEPROM write happens in schedule_sleep, outside interrupt context
+static int64_t checkpoint_alarm_cb(alarm_id_t id, void *user_data) {
+    (void)id; (void)user_data;
+    if (dose_due) {
+        checkpoint_alarm = 0;
+        return 0;
+    }
+    if (checkpoints < UINT16_MAX) checkpoints++;
+    return (int64_t)SCHEDULE_CHECKPOINT_MS * 1000;
+}
+
+// Both wait fields are adjacent, so they go out in one EEPROM write
+static void save_wait(void) {
+    size_t from = offsetof(nv_state_t, dose_wait_dose);
+    size_t to = offsetof(nv_state_t, dose_wait_checkpoints) + sizeof(SCHEDULE_STATE.dose_wait_checkpoints);
+    state_save_range(0, from, to - from);
+}
+
+static void cancel_checkpoints(void) {
+    if (checkpoint_alarm > 0) cancel_alarm(checkpoint_alarm);
+    checkpoint_alarm = 0;
+}
+
+void schedule_init(void) {
+    // Button edges only need to wake the core; the shared GPIO callback ignores them
+    gpio_set_irq_enabled(PIN_BTN_CAL, GPIO_IRQ_EDGE_FALL, true);
+    gpio_set_irq_enabled(PIN_BTN_START, GPIO_IRQ_EDGE_FALL, true);
+}
+
+void schedule_start(void) {
+    last_due = get_absolute_time();
+    resuming = false;
+    SCHEDULE_STATE.dose_wait_dose = SCHEDULE_NO_DOSE;
+    SCHEDULE_STATE.dose_wait_checkpoints = 0;
+    save_wait();
+}
+
+void schedule_resume(void) {
+    last_due = get_absolute_time();
+    resuming = true;
+}
+
+void schedule_set_interval_min(uint8_t dose, uint16_t minutes) {
+    if (dose >= DISPENSE_SLOTS) return;
+    SCHEDULE_STATE.dose_interval_min[dose] = minutes;
+    STATE_SAVE_FIELD(0, dose_interval_min);
+}
+
+uint32_t schedule_interval_ms(uint8_t dose) {
+    if (dose < DISPENSE_SLOTS && SCHEDULE_STATE.dose_interval_min[dose]) {
+        return (uint32_t)SCHEDULE_STATE.dose_interval_min[dose] * 60000u; // 65535 min still fits in 32 bits
+    }
+    return DISPENSE_INTERVAL_MS;
+}
+
+void schedule_set_skip(uint8_t dose, bool skip) {
+    if (dose >= DISPENSE_SLOTS) return;
+    if (skip) SCHEDULE_STATE.dose_skip_mask |= (uint8_t)(1u << dose);
+    else SCHEDULE_STATE.dose_skip_mask &= (uint8_t)~(1u << dose);
+    STATE_SAVE_FIELD(0, dose_skip_mask);
+}
+
+bool schedule_is_skipped(uint8_t dose) {
+    return dose < DISPENSE_SLOTS && (SCHEDULE_STATE.dose_skip_mask & (1u << dose));
+}
+
+void schedule_arm(uint8_t dose) {
+    if (dose_alarm > 0) cancel_alarm(dose_alarm);
+    cancel_checkpoints();
+    dose_due = false;
+
+    // After a reboot, the saved wait for this dose counts toward its interval
+    uint32_t interval = schedule_interval_ms(dose);
+    uint32_t waited = 0;
+    if (resuming && SCHEDULE_STATE.dose_wait_dose == dose) {
+        checkpoints = SCHEDULE_STATE.dose_wait_checkpoints;
+        // Compare in checkpoints first: the product can overflow for a stale count
+        if (checkpoints > interval / SCHEDULE_CHECKPOINT_MS) waited = interval;
+        else waited = (uint32_t)checkpoints * SCHEDULE_CHECKPOINT_MS;
+        printf("(RECOVERY) Resuming dose %u wait, %u s already waited.\n", dose + 1, waited / 1000);
+    } else {
+        checkpoints = 0;
+        SCHEDULE_STATE.dose_wait_dose = dose;
+        SCHEDULE_STATE.dose_wait_checkpoints = 0;
+        save_wait();
+    }
+    resuming = false;
+
+    // Due times chain off the previous due time so motion and sensing don't add drift
+    last_due = delayed_by_ms(last_due, interval - waited);
+    if (interval - waited > SCHEDULE_CHECKPOINT_MS) {
+        checkpoint_alarm = add_alarm_in_ms(SCHEDULE_CHECKPOINT_MS, checkpoint_alarm_cb, NULL, true);
+        if (checkpoint_alarm < 0) checkpoint_alarm = 0;
+    }
+    dose_alarm = add_alarm_at(last_due, dose_alarm_cb, NULL, true);
+    if (dose_alarm <= 0) {
+        // No alarm slot free, or already past: treat as due now
+        dose_alarm = 0;
+        dose_due = true;
+    }
+}
+
+bool schedule_dose_due(void) {
+    return dose_due;
+}
+
+void schedule_fire_now(void) {
+    cancel_checkpoints();
+    if (dose_alarm > 0) cancel_alarm(dose_alarm);
+    dose_alarm = 0;
+    dose_due = true;
+}
+
+// Clocks left running in sleep: the timer (and the watchdog tick that drives it) for
+// the dose alarm, IO for the button and piezo wake-ups, and the stdio links
+#define SLEEP_EN0_KEEP (CLOCKS_SLEEP_EN0_CLK_SYS_IO_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_PADS_BITS | \
+                        SLEEP_EN0_STDIO_USB)
+#define SLEEP_EN1_KEEP (CLOCKS_SLEEP_EN1_CLK_SYS_TIMER_BITS | CLOCKS_SLEEP_EN1_CLK_SYS_WATCHDOG_BITS | \
+                        SLEEP_EN1_STDIO_USB | SLEEP_EN1_STDIO_UART)
+#if LIB_PICO_STDIO_USB
+#define SLEEP_EN0_STDIO_USB CLOCKS_SLEEP_EN0_CLK_SYS_PLL_USB_BITS
+#define SLEEP_EN1_STDIO_USB (CLOCKS_SLEEP_EN1_CLK_SYS_USBCTRL_BITS | CLOCKS_SLEEP_EN1_CLK_USB_USBCTRL_BITS)
+#else
+#define SLEEP_EN0_STDIO_USB 0
+#define SLEEP_EN1_STDIO_USB 0
+#endif
+#if LIB_PICO_STDIO_UART
+#define SLEEP_EN1_STDIO_UART (CLOCKS_SLEEP_EN1_CLK_SYS_UART0_BITS | CLOCKS_SLEEP_EN1_CLK_PERI_UART0_BITS)
+#else
+#define SLEEP_EN1_STDIO_UART 0
+#endif
+
+void schedule_sleep(void) {
+    // Check and sleep with interrupts masked so an alarm firing in between still wakes WFI
+    uint32_t irq = save_and_disable_interrupts();
+    if (!dose_due) {
+        // Deep sleep lets the clock block gate everything not listed in SLEEP_EN
+        uint32_t en0 = clocks_hw->sleep_en0, en1 = clocks_hw->sleep_en1;
+        clocks_hw->sleep_en0 = SLEEP_EN0_KEEP;
+        clocks_hw->sleep_en1 = SLEEP_EN1_KEEP;
+        scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+        __wfi();
+        scb_hw->scr &= ~M0PLUS_SCR_SLEEPDEEP_BITS;
+        clocks_hw->sleep_en0 = en0;
+        clocks_hw->sleep_en1 = en1;
+    }
+    restore_interrupts(irq);
+
+    if (!dose_due && checkpoints != SCHEDULE_STATE.dose_wait_checkpoints) {
+        SCHEDULE_STATE.dose_wait_checkpoints = checkpoints;
+        STATE_SAVE_FIELD(0, dose_wait_checkpoints);
+    }
+}
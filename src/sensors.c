@@ -3,44 +3,51 @@
 #include "config.h"
 #include "sensors.h"
 
-// Global flag set by interrupt
-static volatile bool piezo_triggered = false;
+static const uint8_t opto_pins[WHEEL_COUNT] = WHEEL_OPTO_PINS;
+static const uint8_t piezo_pins[WHEEL_COUNT] = WHEEL_PIEZO_PINS;
+
+// Per-wheel flags set by interrupt
+static DEVICE_LOCAL volatile bool piezo_triggered[WHEEL_COUNT];
 
 // Interrupt handler: must return void
 void gpio_irq_handler(uint gpio, uint32_t events) {
-    if (gpio == PIN_PIEZO && (events & (GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE))) {
-        piezo_triggered = true;   // mark that a pill hit was detected
+    if (!(events & (GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE))) return;
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        if (gpio == piezo_pins[w]) {
+            piezo_triggered[w] = true;   // mark that a pill hit was detected
+        }
     }
 }
 
 void sensors_init(void) {
-
-    gpio_init(PIN_OPTO);
-    gpio_set_dir(PIN_OPTO, GPIO_IN);
-    gpio_pull_up(PIN_OPTO);
-
-    gpio_init(PIN_PIEZO);
-    gpio_set_dir(PIN_PIEZO, GPIO_IN);
-    gpio_pull_up(PIN_PIEZO);
-
-    // Register interrupt for piezo
-    gpio_set_irq_enabled_with_callback(
-        PIN_PIEZO,
-        GPIO_IRQ_EDGE_FALL,
-        true,
-        &gpio_irq_handler
-    );
+    for (uint8_t w = 0; w < WHEEL_COUNT; ++w) {
+        gpio_init(opto_pins[w]);
+        gpio_set_dir(opto_pins[w], GPIO_IN);
+        gpio_pull_up(opto_pins[w]);
+
+        gpio_init(piezo_pins[w]);
+        gpio_set_dir(piezo_pins[w], GPIO_IN);
+        gpio_pull_up(piezo_pins[w]);
+
+        // Register interrupt for piezo
+        gpio_set_irq_enabled_with_callback(
+            piezo_pins[w],
+            GPIO_IRQ_EDGE_FALL,
+            true,
+            &gpio_irq_handler
+        );
+    }
 }
 
 // This must exist for stepper.c to link!
-bool opto_is_opening_at_sensor(void) {
-    return !gpio_get(PIN_OPTO);
+bool opto_is_opening_at_sensor(uint8_t wheel) {
+    return !gpio_get(opto_pins[wheel]);
 }
 
-bool piezo_was_triggered(void) {
-    return piezo_triggered;
+bool piezo_was_triggered(uint8_t wheel) {
+    return piezo_triggered[wheel];
 }
 
-void piezo_reset_flag(void) {
-    piezo_triggered = false;
+void piezo_reset_flag(uint8_t wheel) {
+    piezo_triggered[wheel] = false;
 }
@@ -4,37 +4,50 @@
 #include "state.h"
 #include "eeprom.h"
 
-nv_state_t g_state;
+DEVICE_LOCAL nv_state_t g_states[WHEEL_COUNT];
 
-void state_init_defaults(void) {
-    memset(&g_state, 0, sizeof(g_state));
-    g_state.magic = STATE_MAGIC;
-    g_state.version = STATE_VERSION;
-    g_state.current_slot = CALIBRATION_SLOT_INDEX;
-    g_state.dispenses_done = 0;
-    g_state.pills_remaining = DISPENSE_SLOTS;
-    g_state.joined_network = false;
-    g_state.motor_in_progress = false;
-    g_state.calibrated = false;
-    g_state.steps_per_slot = 512; // default fallback
+static uint16_t state_addr(uint8_t wheel) {
+    return EEPROM_STATE_ADDR + (uint16_t)wheel * EEPROM_STATE_SIZE;
+}
+
+void state_init_defaults(uint8_t wheel) {
+    nv_state_t *st = &g_states[wheel];
+    memset(st, 0, sizeof(*st));
+    st->magic = STATE_MAGIC;
+    st->version = STATE_VERSION;
+    st->current_slot = CALIBRATION_SLOT_INDEX;
+    st->dispenses_done = 0;
+    st->pills_remaining = DISPENSE_SLOTS;
+    st->joined_network = false;
+    st->motor_in_progress = false;
+    st->calibrated = false;
+    st->steps_per_slot = 512; // default fallback
 
 }
 
-void state_load(void) {
-    uint8_t buf[EEPROM_STATE_SIZE];
-    if (!eeprom_read(EEPROM_STATE_ADDR, buf, sizeof(buf))) {
-        state_init_defaults();
-        return;
+// Returns false if the stored record was unreadable or invalid and defaults were used
+bool state_load(uint8_t wheel) {
+    nv_state_t *st = &g_states[wheel];
+    // Only the struct itself is read; the rest of EEPROM_STATE_SIZE is padding
+    if (!eeprom_read(state_addr(wheel), (uint8_t *)st, sizeof(nv_state_t))) {
+        state_init_defaults(wheel);
+        return false;
     }
-    memcpy(&g_state, buf, sizeof(nv_state_t));
-    if (g_state.magic != STATE_MAGIC || g_state.version != STATE_VERSION) {
-        state_init_defaults();
+    if (st->magic != STATE_MAGIC || st->version != STATE_VERSION) {
+        state_init_defaults(wheel);
+        return false;
     }
+    return true;
 }
 
-void state_save(void) {
+void state_save(uint8_t wheel) {
     uint8_t buf[EEPROM_STATE_SIZE];
     memset(buf, 0, sizeof(buf));
-    memcpy(buf, &g_state, sizeof(nv_state_t));
-    eeprom_write(EEPROM_STATE_ADDR, buf, sizeof(buf));
+    memcpy(buf, &g_states[wheel], sizeof(nv_state_t));
+    eeprom_write(state_addr(wheel), buf, sizeof(buf));
+}
+
+void state_save_range(uint8_t wheel, size_t offset, size_t len) {
+    if (offset + len > sizeof(nv_state_t)) return;
+    eeprom_write(state_addr(wheel) + offset, (const uint8_t *)&g_states[wheel] + offset, len);
 }
@@ -7,6 +7,7 @@
 #include "util.h"
 #include "sensors.h"
 #include "eeprom.h"
+#include "proto.h"
 
 static const uint8_t seq_halfstep[8] = {
     0b0001, // A
@@ -18,110 +19,244 @@ static const uint8_t seq_halfstep[8] = {
     0b1000, // D
     0b1001  // D+A
 };
-static int seq_index = 0;
+static const char *const mode_names[STEPPER_MODE_COUNT] = {
+    "wave", "full-step", "half-step"
+};
+
+static const uint8_t wheel_pins[WHEEL_COUNT][4] = WHEEL_STEPPER_PINS;
+
+static void apply_mask(stepper_t *m, uint8_t mask) {
+    gpio_put(m->pins[0], (mask & 0x1) ? 1 : 0);
+    gpio_put(m->pins[1], (mask & 0x2) ? 1 : 0);
+    gpio_put(m->pins[2], (mask & 0x4) ? 1 : 0);
+    gpio_put(m->pins[3], (mask & 0x8) ? 1 : 0);
+}
+
+void stepper_init(stepper_t *m, uint8_t wheel) {
+    m->wheel = wheel;
+    m->state = &g_states[wheel];
+    m->mode = STEPPER_MODE_HALF;
+    m->seq_phase = 7;          // first half-step energises A
+    m->position_half = 0;
+    m->current_slot = CALIBRATION_SLOT_INDEX;
+    m->busy = false;
+    m->move_steps = 0;
+    m->move_done = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        m->pins[i] = wheel_pins[wheel][i];
+        gpio_init(m->pins[i]);
+        gpio_set_dir(m->pins[i], GPIO_OUT);
+    }
+    apply_mask(m, 0);
+}
+
+void stepper_mark_motion_begin(stepper_t *m) {
+    printf("(STEPPER) Wheel %u motion begin. Persisting flag for power-loss detection.\n", m->wheel);
+    m->state->motor_in_progress = true;
+    STATE_SAVE_FIELD(m->wheel, motor_in_progress);
+}
+
+void stepper_mark_motion_end(stepper_t *m) {
+    printf("(STEPPER) Wheel %u motion end. Clearing power-loss flag and persisting.\n", m->wheel);
+    m->state->motor_in_progress = false;
+    STATE_SAVE_FIELD(m->wheel, motor_in_progress);
+}
+
+static uint8_t mode_phase_step(stepper_mode_t mode) {
+    return mode == STEPPER_MODE_HALF ? 1 : 2;
+}
+
+static uint32_t mode_step_delay_us(stepper_mode_t mode) {
+    switch (mode) {
+        case STEPPER_MODE_WAVE: return STEPPER_WAVE_DELAY_US;
+        case STEPPER_MODE_FULL: return STEPPER_FULL_DELAY_US;
+        default:                return STEPPER_STEP_DELAY_US;
+    }
+}
+
+void stepper_set_mode(stepper_t *m, stepper_mode_t mode) {
+    if (mode >= STEPPER_MODE_COUNT || mode == m->mode) return;
+    m->mode = mode;
+    printf("(STEPPER) Wheel %u drive mode set to %s.\n", m->wheel, mode_names[mode]);
+}
+
+stepper_mode_t stepper_get_mode(const stepper_t *m) {
+    return m->mode;
+}
+
+// Energise the next phase of the current mode and return the half-steps moved.
+// Wave drive uses the even (single coil) phases, full-step the odd (two coil) ones,
+// so entering either from an off-grid phase only moves one half-step.
+static uint8_t step_once(stepper_t *m) {
+    uint8_t advance = 1;
+    if (m->mode == STEPPER_MODE_WAVE) advance = (m->seq_phase & 1) ? 1 : 2;
+    else if (m->mode == STEPPER_MODE_FULL) advance = (m->seq_phase & 1) ? 2 : 1;
 
-static void apply_mask(uint8_t mask) {
-    gpio_put(PIN_STEPPER_IN1, (mask & 0x1) ? 1 : 0);
-    gpio_put(PIN_STEPPER_IN2, (mask & 0x2) ? 1 : 0);
-    gpio_put(PIN_STEPPER_IN3, (mask & 0x4) ? 1 : 0);
-    gpio_put(PIN_STEPPER_IN4, (mask & 0x8) ? 1 : 0);
+    m->seq_phase = (m->seq_phase + advance) % 8;
+    apply_mask(m, seq_halfstep[m->seq_phase]);
+    m->position_half += advance;
+    return advance;
 }
 
-void stepper_init(void) {
-    gpio_init(PIN_STEPPER_IN1);
-    gpio_init(PIN_STEPPER_IN2);
-    gpio_init(PIN_STEPPER_IN3);
-    gpio_init(PIN_STEPPER_IN4);
-    gpio_set_dir(PIN_STEPPER_IN1, GPIO_OUT);
-    gpio_set_dir(PIN_STEPPER_IN2, GPIO_OUT);
-    gpio_set_dir(PIN_STEPPER_IN3, GPIO_OUT);
-    gpio_set_dir(PIN_STEPPER_IN4, GPIO_OUT);
-    apply_mask(0);
+void stepper_step_sequence_once(stepper_t *m) {
+    step_once(m);
 }
 
-void stepper_mark_motion_begin(void) {
-    printf("(STEPPER) Motion begin. Persisting flag for power-loss detection.\n");
-    g_state.motor_in_progress = true;
-    state_save();
+// Trapezoidal profile: ramp from STEPPER_RAMP_START_US to the mode delay and back down
+static uint32_t ramp_delay_us(const stepper_t *m, uint32_t i, uint32_t steps) {
+    uint32_t target = mode_step_delay_us(m->mode);
+    if (target >= STEPPER_RAMP_START_US) return target;
+
+    uint32_t edge = (i < steps - 1 - i) ? i : steps - 1 - i;
+    if (edge >= STEPPER_RAMP_STEPS) return target;
+    return STEPPER_RAMP_START_US - (STEPPER_RAMP_START_US - target) * edge / STEPPER_RAMP_STEPS;
+}
+
+// Runs in the timer IRQ: one step per fire, rescheduled relative to the previous fire
+static int64_t motion_alarm_cb(alarm_id_t id, void *user_data) {
+    (void)id;
+    stepper_t *m = (stepper_t *)user_data;
+    if (m->move_done >= m->move_steps) {
+        apply_mask(m, 0);
+        m->busy = false;
+        return 0;
+    }
+    step_once(m);
+    return ramp_delay_us(m, m->move_done++, m->move_steps);
+}
+
+void stepper_steps_async(stepper_t *m, uint32_t steps) {
+    stepper_wait(m);
+    m->move_steps = steps;
+    m->move_done = 0;
+    m->busy = true;
+    if (add_alarm_in_us(STEPPER_RAMP_START_US, motion_alarm_cb, m, true) < 0) {
+        // No alarm slot free: run the move inline
+        while (m->busy) {
+            int64_t delay = motion_alarm_cb(0, m);
+            if (delay > 0) sleep_us(delay);
+        }
+    }
+}
+
+bool stepper_busy(const stepper_t *m) {
+    return m->busy;
 }
 
-void stepper_mark_motion_end(void) {
-    printf("[(STEPPER) Motion end. Clearing power-loss flag and persisting.\n");
-    g_state.motor_in_progress = false;
-    state_save();
+// Motion runs from the alarm, so the link can be served while waiting
+void stepper_wait(stepper_t *m) {
+    while (m->busy) {
+        proto_service();
+        tight_loop_contents();
+    }
 }
 
-void stepper_step_sequence_once(void) {
-    apply_mask(seq_halfstep[seq_index]);
-    seq_index = (seq_index + 1) % 8;
+void stepper_steps(stepper_t *m, uint32_t steps) {
+    stepper_steps_async(m, steps);
+    stepper_wait(m);
 }
 
-void stepper_steps(uint32_t steps) {
-    for (uint32_t i = 0; i < steps; ++i) {
-        stepper_step_sequence_once();
-        sleep_us(STEPPER_STEP_DELAY_US);
+// Revolution length in half-steps for the active mode. Full and wave steps cover two
+// half-steps, so their entry is the measurement rounded to what they can reach.
+static uint32_t rev_half_steps(const stepper_t *m) {
+    const nv_state_t *st = m->state;
+    if (st->steps_per_rev[m->mode]) {
+        return (uint32_t)st->steps_per_rev[m->mode] * mode_phase_step(m->mode);
     }
-    apply_mask(0);
+    return (uint32_t)st->steps_per_slot * TOTAL_COMPARTMENTS;
+}
+
+static int32_t slot_position_half(const stepper_t *m, uint8_t slot) {
+    return (int32_t)(rev_half_steps(m) * slot / TOTAL_COMPARTMENTS);
 }
 
-void stepper_advance_one_slot(void) {
-    printf("(STEPPER) Moving one slot (%u steps)...\n", g_state.steps_per_slot);
-    stepper_steps(g_state.steps_per_slot);
+// Slot targets are absolute, so rounding to whole full-steps never accumulates
+void stepper_advance_one_slot_async(stepper_t *m) {
+    stepper_wait(m);
+    uint8_t next = slot_get(m) + 1;
+    if (next >= TOTAL_COMPARTMENTS) {
+        // Wrap before the move; the position is only written from the alarm while busy
+        m->position_half -= (int32_t)rev_half_steps(m);
+        next = 0;
+    }
+    int32_t distance = slot_position_half(m, next) - m->position_half;
+    uint8_t per_step = mode_phase_step(m->mode);
+    uint32_t steps = distance > 0 ? ((uint32_t)distance + per_step / 2) / per_step : 0;
+
+    printf("(STEPPER) Wheel %u moving one slot (%u %s steps)...\n",
+           m->wheel, steps, mode_names[m->mode]);
+    stepper_steps_async(m, steps);
 }
 
-void stepper_full_turn_nominal(void) {
+void stepper_advance_one_slot(stepper_t *m) {
+    stepper_advance_one_slot_async(m);
+    stepper_wait(m);
+}
+
+void stepper_full_turn_nominal(stepper_t *m) {
     printf("(STEPPER) Performing  full turn (%u steps)...\n", NOMINAL_FULL_REV_STEPS);
-    stepper_steps(NOMINAL_FULL_REV_STEPS);
+    stepper_steps(m, NOMINAL_FULL_REV_STEPS);
 }
 
-static bool opto_read_stable(void) {
+static bool opto_read_stable(const stepper_t *m) {
     int low = 0, high = 0;
     for (int i = 0; i < 8; ++i) {
-        bool v = opto_is_opening_at_sensor();
+        bool v = opto_is_opening_at_sensor(m->wheel);
         if (v) high++; else low++;
         sleep_us(300);
     }
     return high > low;
 }
 
-static  bool opto_raw_open(void)   { return opto_is_opening_at_sensor(); }
-static bool opto_raw_closed(void) { return !opto_is_opening_at_sensor(); }
+// Calibration step delay; serving the link here can only make a step slower, never faster
+static void cal_step_delay(const stepper_t *m) {
+    uint32_t delay = mode_step_delay_us(m->mode);
+    uint32_t t = time_us_32();
+    proto_service();
+    uint32_t spent = time_us_32() - t;
+    if (spent < delay) sleep_us(delay - spent);
+}
+
+static bool opto_raw_open(const stepper_t *m)   { return opto_is_opening_at_sensor(m->wheel); }
+static bool opto_raw_closed(const stepper_t *m) { return !opto_is_opening_at_sensor(m->wheel); }
 
-static bool seek_open_then_confirm(uint32_t max_steps) {
+static bool seek_open_then_confirm(stepper_t *m, uint32_t max_steps) {
     for (uint32_t i = 0; i < max_steps; ++i) {
-        stepper_step_sequence_once();
-        sleep_us(STEPPER_STEP_DELAY_US);
-        if (opto_raw_open()) {
+        step_once(m);
+        cal_step_delay(m);
+        if (opto_raw_open(m)) {
             // Confirm with stable read
-            if (opto_read_stable()) return true;
+            if (opto_read_stable(m)) return true;
         }
     }
     return false;
 }
 
-static bool seek_closed_then_confirm(uint32_t max_steps) {
+static bool seek_closed_then_confirm(stepper_t *m, uint32_t max_steps) {
     for (uint32_t i = 0; i < max_steps; ++i) {
-        stepper_step_sequence_once();
-        sleep_us(STEPPER_STEP_DELAY_US);
-        if (opto_raw_closed()) {
-            if (!opto_read_stable()) return true;
+        step_once(m);
+        cal_step_delay(m);
+        if (opto_raw_closed(m)) {
+            if (!opto_read_stable(m)) return true;
         }
     }
     return false;
 }
 
 // Count one revolution
-uint32_t stepper_calibrate_revolution(void) {
-    printf("(CAL) Seeking first hole...\n");
+uint32_t stepper_calibrate_revolution(stepper_t *m) {
+    stepper_wait(m);
+    printf("(CAL) Wheel %u seeking first hole...\n", m->wheel);
 
     // Seek hole anywhere within 2 nominal turns
-    if (!seek_open_then_confirm(NOMINAL_FULL_REV_STEPS * 2)) {
+    if (!seek_open_then_confirm(m, NOMINAL_FULL_REV_STEPS * 2)) {
         printf("(CAL) Failed to find initial OPEN within timeout.\n");
         return 0;
     }
 
     // Leave hole at edge right after hole
-    if (!seek_closed_then_confirm(NOMINAL_FULL_REV_STEPS / 2)) {
+    if (!seek_closed_then_confirm(m, NOMINAL_FULL_REV_STEPS / 2)) {
         printf("(CAL) Failed to leave hole to CLOSED.\n");
         return 0;
     }
@@ -130,16 +265,16 @@ uint32_t stepper_calibrate_revolution(void) {
 
     // count steps until we hit the next hole
     while (steps < NOMINAL_FULL_REV_STEPS * 2) {
-        stepper_step_sequence_once();
-        sleep_us(STEPPER_STEP_DELAY_US);
+        step_once(m);
+        cal_step_delay(m);
         steps++;
-        if (opto_raw_open() && opto_read_stable()) {
+        if (opto_raw_open(m) && opto_read_stable(m)) {
             // now leave the hole to finish the revolution at the end of hole
             while (steps < NOMINAL_FULL_REV_STEPS * 2) {
-                stepper_step_sequence_once();
-                sleep_us(STEPPER_STEP_DELAY_US);
+                step_once(m);
+                cal_step_delay(m);
                 steps++;
-                if (opto_raw_closed() && !opto_read_stable()) {
+                if (opto_raw_closed(m) && !opto_read_stable(m)) {
                     printf("(CAL) Revolution complete at end of hole. Steps=%u\n", steps);
                     return steps;
                 }
@@ -154,30 +289,43 @@ uint32_t stepper_calibrate_revolution(void) {
 }
 
 // Count two consecutive revolutions
-bool calibrate_two_revolutions(uint32_t *rev1_steps, uint32_t *rev2_steps) {
-    *rev1_steps = stepper_calibrate_revolution();
+bool calibrate_two_revolutions(stepper_t *m, uint32_t *rev1_steps, uint32_t *rev2_steps) {
+    *rev1_steps = stepper_calibrate_revolution(m);
     if (*rev1_steps == 0) return false;
 
-    *rev2_steps = stepper_calibrate_revolution();
+    *rev2_steps = stepper_calibrate_revolution(m);
     if (*rev2_steps == 0) return false;
 
     return true;
 }
 
-static uint8_t current_slot = CALIBRATION_SLOT_INDEX;
+// Store a revolution measured in the active mode, converted for every mode so no
+// entry is left over from an older calibration; the wheel is at the calibration slot
+void stepper_store_calibration(stepper_t *m, uint32_t rev_steps) {
+    uint32_t rev_half = rev_steps * mode_phase_step(m->mode);
+    for (int mode = 0; mode < STEPPER_MODE_COUNT; ++mode) {
+        uint8_t per_step = mode_phase_step((stepper_mode_t)mode);
+        m->state->steps_per_rev[mode] = (uint16_t)((rev_half + per_step / 2) / per_step);
+    }
+    m->state->steps_per_slot = (uint16_t)(rev_half / TOTAL_COMPARTMENTS);
+    m->position_half = 0;
+    printf("(CAL) Wheel %u stored %u %s steps per revolution.\n",
+           m->wheel, rev_steps, mode_names[m->mode]);
+}
 
-void slot_set(uint8_t slot_index) {
-    current_slot = slot_index % TOTAL_COMPARTMENTS;
-    printf("(SLOT) Logical slot set to %u.\n", current_slot);
+void slot_set(stepper_t *m, uint8_t slot_index) {
+    m->current_slot = slot_index % TOTAL_COMPARTMENTS;
+    m->position_half = slot_position_half(m, m->current_slot);
+    printf("(SLOT) Wheel %u logical slot set to %u.\n", m->wheel, m->current_slot);
 }
 
-void slot_advance(void) {
-    current_slot = (current_slot + 1) % TOTAL_COMPARTMENTS;
-    g_state.current_slot = current_slot;
-    state_save();
-    printf("(SLOT) Logical slot advanced. Current=%u.\n", current_slot);
+void slot_advance(stepper_t *m) {
+    m->current_slot = (m->current_slot + 1) % TOTAL_COMPARTMENTS;
+    m->state->current_slot = m->current_slot;
+    STATE_SAVE_FIELD(m->wheel, current_slot);
+    printf("(SLOT) Wheel %u logical slot advanced. Current=%u.\n", m->wheel, m->current_slot);
 }
 
-uint8_t slot_get(void) {
-    return current_slot;
+uint8_t slot_get(const stepper_t *m) {
+    return m->current_slot;
 }